@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# benchmark.sh: wirbelscan - A plugin for the Video Disk Recorder
+#
+# Runs complete scans against transport stream recordings (see replay.h)
+# and appends one line of JSON per scan to $OUT:
+#
+#   DVB-T  country sweep          (COUNTRY, default 80 = DE)
+#   DVB-C  symbol rate loop       (all symbol rates, QAM auto)
+#   DVB-S  satellite of sat_list  (SAT, default 6 = S19E2)
+#
+# Scan types without recordings in $REPLAY are skipped.
+#
+# usage: REPLAY=dir [OUT=file] [SPEED=n] [VDR=vdr] [PORT=n] sh benchmark.sh
+#
+# $Id$
+
+REPLAY=${REPLAY:?"REPLAY=<dir of recordings> is required"}
+OUT=${OUT:-$(pwd)/benchmark.json}
+SPEED=${SPEED:-0}
+VDR=${VDR:-vdr}
+SVDRPSEND=${SVDRPSEND:-svdrpsend}
+PORT=${PORT:-6419}
+LIBDIR=${LIBDIR:-$(pwd)/../../lib}
+COUNTRY=${COUNTRY:-80}
+SAT=${SAT:-6}
+TIMEOUT=${TIMEOUT:-3600}
+
+WORK=$(mktemp -d /tmp/wirbelscan-benchmark.XXXXXX) || exit 1
+mkdir -p $WORK/conf $WORK/video
+touch $WORK/conf/channels.conf
+
+$VDR -c $WORK/conf -v $WORK/video -L $LIBDIR -p $PORT --no-kbd -l 0 \
+     -P "wirbelscan --replay=$REPLAY --replay-speed=$SPEED --benchmark=$OUT" &
+PID=$!
+trap "kill $PID 2>/dev/null; wait $PID; rm -rf $WORK" EXIT INT TERM
+sleep 5
+
+plug() {
+  $SVDRPSEND -p $PORT PLUG wirbelscan "$@" | grep '^[0-9][0-9][0-9][ -]'
+}
+
+# scan <type> <srate> <cmd>, waits until the scan appended its line to $OUT.
+scan() {
+  lines=$(cat $OUT 2>/dev/null | wc -l)
+  plug SETUP "0:2:$1:0:0:$2:0:$COUNTRY:$SAT:1:0:31" >/dev/null
+  plug $3 | grep -q "started" || { echo "$3: not started"; return; }
+  waited=0
+  while [ $(cat $OUT 2>/dev/null | wc -l) -le $lines ]; do
+    sleep 1
+    waited=$((waited + 1))
+    if [ $waited -ge $TIMEOUT ]; then
+      plug S_STOP >/dev/null
+      echo "$3: timeout"
+      return
+    fi
+  done
+  tail -n 1 $OUT
+}
+
+ls $REPLAY | grep -q '^T-' && scan 0 0  S_TERR
+ls $REPLAY | grep -q '^C-' && scan 1 16 S_CABL
+ls $REPLAY | grep -q '^S' && scan 2 0  S_SAT
+exit 0
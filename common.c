@@ -33,6 +33,10 @@ cMySetup::cMySetup(void) {
   scanflags       = SCAN_TV | SCAN_RADIO | SCAN_FTA | SCAN_SCRAMBLED | SCAN_HD;
   initsystems     = false;
   enable_pvrinput = false;
+  parallel_tables = 1;
+  pmt_filters     = 16;
+  incremental     = 0;
+  warm_start      = 0;
 }
 
 void cMySetup::InitSystems(void) {
@@ -69,30 +73,177 @@ void cMySetup::InitSystems(void) {
 
 cMySetup wSetup;                   
 
-void dlog(const int level, const char *fmt, ...) {
-  char t[BUFSIZ] = { 0 };
-  va_list ap;
-  time_t  now;
-  if (wSetup.verbosity >= level){
-    va_start(ap, fmt);
-    switch (wSetup.logFile) {
-      case STDOUT : time(&now);
-                    vsnprintf(t + 9, sizeof t - 9, fmt, ap);
-                    strftime(t, sizeof t, "%H:%M:%S", localtime(&now));
-                    t[8] = ' ';
-                    printf("\r%s\033[K\r\n", t);
-                    fflush(stdout);
-                    break;
-      case SYSLOG : vsnprintf(t, sizeof t, fmt, ap);
-                    syslog(LOG_DEBUG, "%s", t);
-                    break;
-      default:      printf("WARNING: setting logFile to %d\n",
-                          (wSetup.logFile = STDOUT));
+//--------cLogWriter--------------------------------------------------------------------------
+// dlog() only formats its message into a ring buffer; printing, syslog and
+// OSD are done by the writer thread. Many producers (scan and filter threads),
+// one consumer; the slots are claimed by compare and swap on their sequence
+// numbers, see D. Vyukov's bounded MPMC queue. If the buffer is full,
+// messages are dropped and counted. While the writer thread isn't running,
+// ie. before plugin start and after plugin stop, dlog() prints at once.
+
+#define _LOGSLOTS                             256  //power of 2
+#define _LOGMSGSIZE                           512
+
+class cLogWriter : public cThread {
+private:
+  class cSlot {
+public:
+    volatile uint seq;
+    time_t        time;
+    char          text[_LOGMSGSIZE];
+    };
+  cSlot         slots[_LOGSLOTS];
+  volatile uint head;           // next slot to write
+  uint          tail;           // next slot to read, writer thread only
+  volatile uint dropped;
+  uint          reported;       // dropped messages already reported
+  volatile bool sleeping;
+  cCondWait     wakeup;
+  static void Format(char * Buffer, int Size, const char * fmt, va_list ap);
+  static void Deliver(time_t Time, char * t);
+  bool Write(void);
+protected:
+  virtual void Action(void);
+public:
+  cLogWriter(void);
+  void Put(const char * fmt, va_list ap);
+  void Print(const char * fmt, va_list ap);
+  void Stop(void);
+  };
+
+static cLogWriter LogWriter;
+
+cLogWriter::cLogWriter(void) : cThread("wirbelscan log") {
+  for (uint i = 0; i < _LOGSLOTS; i++)
+    slots[i].seq = i;
+  head = tail = 0;
+  dropped = reported = 0;
+  sleeping = false;
+  }
+
+void cLogWriter::Format(char * Buffer, int Size, const char * fmt, va_list ap) {
+  if (vsnprintf(Buffer, Size, fmt, ap) >= Size) {
+    // mark the truncation, without leaving half of an UTF-8 character.
+    char * p = Buffer + Size - 4;
+    while ((p > Buffer) && ((*p & 0xC0) == 0x80))
+      p--;
+    strcpy(p, "...");
+    }
+  }
+
+void cLogWriter::Put(const char * fmt, va_list ap) {
+  uint    pos = head;
+  cSlot * slot;
+
+  for (;;) {
+    slot = &slots[pos & (_LOGSLOTS - 1)];
+    int diff = (int) (slot->seq - pos);
+    if (diff == 0) {
+      if (__sync_bool_compare_and_swap(&head, pos, pos + 1))
+        break;
+      pos = head;
+      }
+    else if (diff < 0) {
+      __sync_fetch_and_add(&dropped, 1);  // full
+      return;
+      }
+    else
+      pos = head;
+    }
+  slot->time = time(NULL);
+  Format(slot->text, sizeof(slot->text), fmt, ap);
+  __sync_synchronize();
+  slot->seq = pos + 1;      // publish
+  __sync_synchronize();
+  if (sleeping)
+    wakeup.Signal();
+  }
+
+// synchronous, without the writer thread.
+void cLogWriter::Print(const char * fmt, va_list ap) {
+  char t[_LOGMSGSIZE + 9];
+
+  Format(t + 9, _LOGMSGSIZE, fmt, ap);
+  Deliver(time(NULL), t);
+  }
+
+// delivers one message, false if there is none.
+bool cLogWriter::Write(void) {
+  cSlot * slot = &slots[tail & (_LOGSLOTS - 1)];
+  char    t[_LOGMSGSIZE + 9];
+  time_t  when;
+
+  if (slot->seq != tail + 1)
+    return (false);
+  __sync_synchronize();
+  when = slot->time;
+  strcpy(t + 9, slot->text);
+  __sync_synchronize();
+  slot->seq = tail + _LOGSLOTS;   // free again
+  tail++;
+  Deliver(when, t);
+  return (true);
+  }
+
+// t: the message at t + 9, the first 9 chars are filled in with the time.
+void cLogWriter::Deliver(time_t Time, char * t) {
+  struct tm tm;
+
+  strftime(t, 9, "%H:%M:%S", localtime_r(&Time, &tm));
+  t[8] = ' ';
+  switch (wSetup.logFile) {
+    case STDOUT : printf("\r%s\033[K\r\n", t);
+                  fflush(stdout);
+                  break;
+    case SYSLOG : syslog(LOG_DEBUG, "%s", t + 9);
+                  break;
+    default:      printf("WARNING: setting logFile to %d\n",
+                        (wSetup.logFile = STDOUT));
+    }
+  if (MenuScanning)
+    MenuScanning->AddLogMsg(wSetup.logFile == STDOUT ? t : t + 9);
+  }
+
+void cLogWriter::Action(void) {
+  while (Running()) {
+    while (Write());
+    if (dropped != reported) {
+      uint d = dropped;
+      syslog(LOG_WARNING, "wirbelscan: %u log messages dropped", d - reported);
+      reported = d;
       }
-    va_end(ap);
-    if (MenuScanning)
-      MenuScanning->AddLogMsg(t);
+    sleeping = true;
+    __sync_synchronize();
+    if (slots[tail & (_LOGSLOTS - 1)].seq != tail + 1)
+      wakeup.Wait(1000);
+    sleeping = false;
     }
+  while (Write());   // flush
+  }
+
+void cLogWriter::Stop(void) {
+  Cancel(-1);        // Running() false
+  wakeup.Signal();
+  Cancel(3);
+  while (Write());   // put in after the thread's last flush
+  }
+
+void StartLogWriter(void) {
+  LogWriter.Start();
+  }
+
+void StopLogWriter(void) {
+  LogWriter.Stop();
+  }
+
+void LogMessage(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  if (LogWriter.Active())
+    LogWriter.Put(fmt, ap);
+  else
+    LogWriter.Print(fmt, ap);
+  va_end(ap);
 }
 
 void hexdump(const char * intro, const unsigned char * buf, int len) {
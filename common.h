@@ -57,6 +57,10 @@ class cMySetup {
   int systems[6];
   bool initsystems;
   bool enable_pvrinput;
+  int parallel_tables;  // collect NIT, PAT/PMT and SDT of a transponder at the same time
+  int pmt_filters;      // max PMT pids filtered at the same time
+  int incremental;      // skip PAT/PMT and SDT of transport streams with unchanged table versions
+  int warm_start;       // seed scans from the transponders of the last scan, sweep only if none of them locks
   cMySetup(void);
   void InitSystems();
 };
@@ -64,7 +68,12 @@ extern cMySetup wSetup;
 
 
 /* generic functions */
-void  dlog(const int level, const char *fmt, ...);
+void  LogMessage(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+// the level is checked before arguments are evaluated, so *PrintTransponder(t)
+// and similar cost nothing while suppressed by verbosity.
+#define dlog(level, x...)  do { if (wSetup.verbosity >= (level)) LogMessage(x); } while (0)
+void  StartLogWriter(void);   // dlog() is delivered by a thread of its own
+void  StopLogWriter(void);    // delivers pending messages and stops, dlog() prints at once from then on
 void  hexdump(const char * intro, const unsigned char * buf, int len);
 int   IOCTL(int fd, int cmd, void * data);
 bool  FileExists(const char * aFile);
@@ -17,6 +17,7 @@
 #include <vdr/diseqc.h>
 #include "common.h"
 #include "dvb_wrapper.h"
+#include "replay.h"
 #include <ctype.h>
 
 #if (DVB_API_VERSION < 5)
@@ -732,94 +733,271 @@ bool SetTerrTransponderDataFromVDR(cChannel * channel, int Source, int Frequency
 }
 
 
+//--------cFrontends--------------------------------------------------------------------------
+// One read only handle per adapter (frontend0), kept open until CloseFrontends(),
+// and its FE_GET_INFO, which doesn't change. Saves an open(), close() and
+// FE_GET_INFO on each status, strength or capability query.
+
+class cFrontends {
+private:
+  class cFrontend {
+public:
+    cMutex mutex;          // guards fd, while it's in use
+    int  fd;
+    bool haveInfo;
+    struct dvb_frontend_info info;
+    };
+  cFrontend frontends[MAXDEVICES];
+  int Open(int cardIndex);
+public:
+  cFrontends(void);
+  ~cFrontends(void) { Close(); };
+  bool Info(int cardIndex, struct dvb_frontend_info * Info);
+  bool Status(int cardIndex, fe_status_t * Status);
+  bool Stats(int cardIndex, sSignalStats * Stats);
+  void Close(void);
+  };
+
+static cFrontends Frontends;
+
+cFrontends::cFrontends(void) {
+  for (int i = 0; i < MAXDEVICES; i++) {
+    frontends[i].fd = -1;
+    frontends[i].haveInfo = false;
+    }
+}
+
+// handle of cardIndex, -1 on error. mutex of frontends[cardIndex] has to be locked.
+int cFrontends::Open(int cardIndex) {
+  cFrontend * f = &frontends[cardIndex];
+  if (f->fd < 0) {
+     cString dev = cString::sprintf("/dev/dvb/adapter%d/frontend%d", cardIndex, 0);
+     if ((f->fd = open(*dev, O_RDONLY | O_NONBLOCK)) < 0)
+        dlog(0, "could not open %s", *dev);
+     }
+  return f->fd;
+}
+
+bool cFrontends::Info(int cardIndex, struct dvb_frontend_info * Info) {
+  if ((cardIndex < 0) || (cardIndex >= MAXDEVICES))
+     return false;
+  cMutexLock lock(&frontends[cardIndex].mutex);
+  int fd = Open(cardIndex);
+  if (fd < 0)
+     return false;
+  cFrontend * f = &frontends[cardIndex];
+  if (! f->haveInfo) {
+     if (IOCTL(fd, FE_GET_INFO, &f->info) < 0) {
+        dlog(0, "could not read frontend info of adapter %d", cardIndex);
+        return false;
+        }
+     f->haveInfo = true;
+     }
+  *Info = f->info;
+  return true;
+}
+
+// Polled value, so no retries as by IOCTL().
+bool cFrontends::Status(int cardIndex, fe_status_t * Status) {
+  if ((cardIndex < 0) || (cardIndex >= MAXDEVICES))
+     return false;
+  cMutexLock lock(&frontends[cardIndex].mutex);
+  int fd = Open(cardIndex);
+  return ((fd >= 0) && (ioctl(fd, FE_READ_STATUS, Status) == 0));
+}
+
+/* status and all statistics in one FE_GET_PROPERTY; strength from
+ * FE_READ_SIGNAL_STRENGTH, if the driver has no relative DTV_STAT_SIGNAL_STRENGTH.
+ */
+bool cFrontends::Stats(int cardIndex, sSignalStats * Stats) {
+  fe_status_t status;
+  uint16_t strength;
+
+  memset(Stats, 0, sizeof(*Stats));
+  Stats->strength = -1;
+  if ((cardIndex < 0) || (cardIndex >= MAXDEVICES))
+     return false;
+  cMutexLock lock(&frontends[cardIndex].mutex);  // recursive, Status() locks it again
+  if (! Status(cardIndex, &status))
+     return false;
+  Stats->status = status;
+  int fd = frontends[cardIndex].fd;
+
+  #ifdef DTV_STAT_SIGNAL_STRENGTH
+  struct dtv_property p[4];
+  struct dtv_properties pl;
+  memset(p, 0, sizeof(p));
+  p[0].cmd = DTV_STAT_SIGNAL_STRENGTH;
+  p[1].cmd = DTV_STAT_CNR;
+  p[2].cmd = DTV_STAT_PRE_ERROR_BIT_COUNT;
+  p[3].cmd = DTV_STAT_PRE_TOTAL_BIT_COUNT;
+  pl.num = 4;
+  pl.props = p;
+  if (ioctl(fd, FE_GET_PROPERTY, &pl) == 0) {
+     for (int i = 0; i < 4; i++) {
+       if (! p[i].u.st.len)
+          continue;
+       struct dtv_stats * st = &p[i].u.st.stat[0];   // global value, not per layer
+       switch (p[i].cmd) {
+          case DTV_STAT_SIGNAL_STRENGTH:
+               if (st->scale == FE_SCALE_RELATIVE)
+                  Stats->strength = st->uvalue;
+               else if (st->scale == FE_SCALE_DECIBEL) {
+                  Stats->hasLevel = true;
+                  Stats->level = st->svalue;
+                  }
+               break;
+          case DTV_STAT_CNR:
+               if (st->scale == FE_SCALE_DECIBEL) {
+                  Stats->hasCnr = true;
+                  Stats->cnr = st->svalue;
+                  }
+               break;
+          case DTV_STAT_PRE_ERROR_BIT_COUNT:
+               if (st->scale == FE_SCALE_COUNTER)
+                  Stats->bitErrors = st->uvalue;
+               break;
+          case DTV_STAT_PRE_TOTAL_BIT_COUNT:
+               if (st->scale == FE_SCALE_COUNTER)
+                  Stats->bitCount = st->uvalue;
+               break;
+          default:;
+          }
+       }
+     }
+  #endif
+  if ((Stats->strength < 0) && (ioctl(fd, FE_READ_SIGNAL_STRENGTH, &strength) == 0))
+     Stats->strength = strength;
+  return true;
+}
+
+void cFrontends::Close(void) {
+  for (int i = 0; i < MAXDEVICES; i++) {
+    cMutexLock lock(&frontends[i].mutex);
+    if (frontends[i].fd >= 0)
+       close(frontends[i].fd);
+    frontends[i].fd = -1;
+    frontends[i].haveInfo = false;  // another frontend may be opened next time
+    }
+}
+
+void CloseFrontends(void) {
+  Frontends.Close();
+}
+
 unsigned int  GetFrontendStatus(int cardIndex) {
+  cReplayDevice * replay = cReplayDevice::Get(cardIndex);
+  if (replay)
+     return replay->HasLock() ? (FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI | FE_HAS_SYNC | FE_HAS_LOCK) : 0;
   fe_status_t value;
-  cString dev = cString::sprintf("/dev/dvb/adapter%d/frontend%d", cardIndex, 0);
 
-  int fe = open(*dev, O_RDONLY | O_NONBLOCK);
-  if (fe < 0) {
-     dlog(0, "GetFrontendStatus(): could not open %s", *dev);
-     return 0;
-     }
-  if (IOCTL(fe, FE_READ_STATUS, &value) < 0) {
-     close(fe);
-     dlog(0, "GetFrontendStatus(): could not read %s", *dev);
+  if (! Frontends.Status(cardIndex, &value)) {
+     dlog(0, "GetFrontendStatus(): could not read adapter %d", cardIndex);
      return 0;
      }
-  close(fe);
   return value;
 }
 
 unsigned int  GetFrontendStrength(int cardIndex) {
-  uint16_t value;
-  cString dev = cString::sprintf("/dev/dvb/adapter%d/frontend%d", cardIndex, 0);
+  cReplayDevice * replay = cReplayDevice::Get(cardIndex);
+  if (replay)
+     return replay->HasLock() ? 0xFFFF : 0;
+  sSignalStats stats;
 
-  int fe = open(*dev, O_RDONLY | O_NONBLOCK);
-  if (fe < 0) {
-     dlog(0, "GetFrontendStatus(): could not open %s", *dev);
+  if (! Frontends.Stats(cardIndex, &stats) || (stats.strength < 0)) {
+     dlog(0, "GetFrontendStrength(): could not read adapter %d", cardIndex);
      return 0;
      }
-  if (IOCTL(fe, FE_READ_SIGNAL_STRENGTH, &value) < 0) {
-     close(fe);
-     dlog(0, "GetFrontendStrength(): could not read %s", *dev);
-     return 0;
+  return stats.strength;
+}
+
+bool GetSignalStats(int cardIndex, sSignalStats * Stats) {
+  cReplayDevice * replay = cReplayDevice::Get(cardIndex);
+  if (replay) {
+     memset(Stats, 0, sizeof(*Stats));
+     Stats->status   = GetFrontendStatus(cardIndex);
+     Stats->strength = replay->HasLock() ? 0xFFFF : 0;
+     return true;
      }
-  close(fe);
-  return value;
+  return Frontends.Stats(cardIndex, Stats);
+}
+
+/* time (ms) a frontend may need to report a carrier at all,
+ * before we treat the frequency as empty. Sat needs extra time
+ * for LNB voltage/tone and DiSEqC switching.
+ */
+static int NoSignalBudget(const cChannel * Channel) {
+  if (Channel->IsSat())   return 1500;
+  if (Channel->IsCable()) return 600;
+  if (Channel->IsTerr())  return 1000;
+  #if VDRVERSNUM > 10713
+  if (Channel->IsAtsc())  return 1000;
+  #endif
+  return 1500;
+}
+
+bool WaitForLock(cDevice * Device, const cChannel * Channel, int Timeout, int * TimeToLock) {
+  int noSignal = min(NoSignalBudget(Channel), Timeout);
+  bool lock = false, signal = false;
+  bool replay = cReplayDevice::Get(Device->CardIndex());
+  fe_status_t status;
+  cTimeMs t;
+
+  if (replay)
+     signal = true; // no frontend
+
+  /* HasLock(0) reflects vdr's own tuner state, which is reset on each
+   * SwitchChannel(); FE_READ_STATUS is only used to give up early on
+   * empty frequencies, as it may still show the previous transponder.
+   */
+  while ((int) t.Elapsed() < Timeout) {
+     if ((lock = Device->HasLock(0)))
+        break;
+     if (! replay) {
+        if (! Frontends.Status(Device->CardIndex(), &status))
+           status = (fe_status_t) 0;
+        if (status & (FE_HAS_SIGNAL | FE_HAS_LOCK))
+           signal = true;
+        }
+     if (! signal && ((int) t.Elapsed() >= noSignal))
+        break;
+     cCondWait::SleepMs(20);
+     }
+  if (TimeToLock)
+     *TimeToLock = (int) t.Elapsed();
+  return lock;
 }
 
 cString GetFeName(int cardIndex) {
+  cReplayDevice * replay = cReplayDevice::Get(cardIndex);
+  if (replay)
+     return replay->Name();
   struct dvb_frontend_info fe_info;
-  cString dev = cString::sprintf("/dev/dvb/adapter%d/frontend%d", cardIndex, 0);
-  cString fe_name;
-  int fe = open(*dev, O_RDONLY | O_NONBLOCK);
-  if (fe < 0) {
-     dlog(0, "GetCapabilities(): could not open %s", *dev);
-     return 0;
-     }
-  if (IOCTL(fe, FE_GET_INFO, &fe_info) < 0) {
-     close(fe);
-     dlog(0, "GetCapabilities(): could not read %s", *dev);
+
+  if (! Frontends.Info(cardIndex, &fe_info))
      return 0;
-     }
-  close(fe);
-  fe_name = cString::sprintf("%s", (const char *) fe_info.name);
-  return fe_name;
+  return cString::sprintf("%s", (const char *) fe_info.name);
 }
 
 unsigned int GetFeType(int cardIndex) {
+  cReplayDevice * replay = cReplayDevice::Get(cardIndex);
+  if (replay)
+     return replay->FeType();
   struct dvb_frontend_info fe_info;
-  cString dev = cString::sprintf("/dev/dvb/adapter%d/frontend%d", cardIndex, 0);
 
-  int fe = open(*dev, O_RDONLY | O_NONBLOCK);
-  if (fe < 0) {
-     dlog(0, "GetCapabilities(): could not open %s", *dev);
-     return 0;
-     }
-  if (IOCTL(fe, FE_GET_INFO, &fe_info) < 0) {
-     close(fe);
-     dlog(0, "GetCapabilities(): could not read %s", *dev);
+  if (! Frontends.Info(cardIndex, &fe_info))
      return 0;
-     }
-  close(fe);
   return fe_info.type;
 }
 
 unsigned int  GetCapabilities(int cardIndex) {
+  cReplayDevice * replay = cReplayDevice::Get(cardIndex);
+  if (replay)
+     return replay->Capabilities();
   struct dvb_frontend_info fe_info;
-  cString dev = cString::sprintf("/dev/dvb/adapter%d/frontend%d", cardIndex, 0);
 
-  int fe = open(*dev, O_RDONLY | O_NONBLOCK);
-  if (fe < 0) {
-     dlog(0, "GetCapabilities(): could not open %s", *dev);
+  if (! Frontends.Info(cardIndex, &fe_info))
      return 0;
-     }
-  if (IOCTL(fe, FE_GET_INFO, &fe_info) < 0) {
-     close(fe);
-     dlog(0, "GetCapabilities(): could not read %s", *dev);
-     return 0;
-     }
-  close(fe);
   return fe_info.caps;
 }
 
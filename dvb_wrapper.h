@@ -199,12 +199,27 @@ cString PrintChannel(const cChannel * Channel);
 cString PrintDvbApi(void);
 cString PrintDvbApiUsed(int cardIndex);
 
+// one sample of DVBv5 frontend statistics, see GetSignalStats()
+struct sSignalStats {
+  unsigned int status;     // fe_status_t
+  int          strength;   // relative, 0..0xFFFF; -1 if unknown
+  bool         hasLevel;
+  int          level;      // signal level, 0.001 dBm
+  bool         hasCnr;
+  int          cnr;        // carrier to noise, 0.001 dB
+  uint64_t     bitErrors;  // bit errors before the outer decoder,
+  uint64_t     bitCount;   // of that many bits; 0 if unknown
+  };
+
 // DVB frontend capabilities
 unsigned int  GetFrontendStatus  (int cardIndex = 0);
 unsigned int  GetFrontendStrength(int cardIndex = 0);
+bool          GetSignalStats     (int cardIndex, sSignalStats * Stats);
+bool          WaitForLock        (cDevice * Device, const cChannel * Channel, int Timeout, int * TimeToLock = NULL);
 unsigned int  GetCapabilities    (int cardIndex = 0);
 unsigned int  GetFeType          (int cardIndex = 0);
 cString GetFeName(int cardIndex);
+void          CloseFrontends     (void); // frontend handles are kept open until then
 bool GetTerrCapabilities (int cardIndex, bool *CodeRate, bool *Modulation, bool *Inversion, bool *Bandwidth, bool *Hierarchy, bool *TransmissionMode, bool *GuardInterval);
 bool GetCableCapabilities(int cardIndex, bool *CodeRate, bool *Modulation, bool *Inversion);
 bool GetAtscCapabilities (int cardIndex, bool *CodeRate, bool *Modulation, bool *Inversion, bool *VSB, bool * QAM);
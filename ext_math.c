@@ -19,11 +19,6 @@
  * 
  *****************************************************************************/
 
-#define nextquad(a,b,c,d) *(coeff + row * (coeff_rows + 1) + col++) = a; \
-                          *(coeff + row * (coeff_rows + 1) + col++) = b; \
-                          *(coeff + row * (coeff_rows + 1) + col++) = c; \
-                          *(coeff + row * (coeff_rows + 1) + col++) = d
-#define nextres(y)        *(coeff + row * (coeff_rows + 1) + coeff_rows) = y
 #define BSP_POLY_ORD 3          // ATM there is no need for other polynom orders
 #define BSP_NUM_OUTP 5 * size  // resolution output array
 
@@ -54,42 +49,27 @@ static int bsp_compute_intervals(int * u, int num_cp) {
   return 1;
 }
 
-// calculate the bspline blending value
-static double bsp_blend(int k, int t, int * u, double intv) {
-  double retval;
+/* de Boor's algorithm: only the BSP_POLY_ORD + 1 control points of the
+ * knot span k (u[k] <= intv < u[k+1]) contribute to a point.
+ */
+static void bsp_compute_point(int * u, int k, double intv, double * svars, double * results) {
+  double d[BSP_POLY_ORD + 1][2];
+  int j, r;
 
-  if (t == 1) {      // base case for the recursion
-    if ((u[k] <= intv) && (intv < u[k+1]))
-      retval = 1.0;
-    else
-      retval = 0.0;
-    }
-  else {
-    if ((u[k+t-1]==u[k]) && (u[k+t]==u[k+1]))  // check for divide by zero
-      retval = 0.0;
-    else if (u[k+t-1]==u[k]) // if a term's denominator is zero,use just the other
-      retval = (u[k+t] - intv) / (u[k+t] - u[k+1]) * bsp_blend(k+1, t-1, u, intv);
-    else if (u[k+t]==u[k+1])
-      retval = (intv - u[k]) / (u[k+t-1] - u[k]) * bsp_blend(k, t-1, u, intv);
-    else
-      retval = (intv - u[k])   / (u[k+t-1] - u[k]) * bsp_blend(k,   t-1, u, intv) +
-               (u[k+t] - intv) / (u[k+t] - u[k+1]) * bsp_blend(k+1, t-1, u, intv);
+  for (j = 0; j <= BSP_POLY_ORD; j++) {
+    d[j][0] = *(svars + (j + k - BSP_POLY_ORD)*2 + 0);
+    d[j][1] = *(svars + (j + k - BSP_POLY_ORD)*2 + 1);
     }
-  return retval;
-}
-
-static void bsp_compute_point(int * u, int size, double intv, double * svars, double * results) {
-  int i;
-  double tmp;
-
-  *(results + 0) = 0;
-  *(results + 1) = 0;
-
-  for (i = 0; i < size; i++) {
-    tmp = bsp_blend(i,BSP_POLY_ORD + 1,u,intv);
-    *(results + 0) += (*(svars + i*2 + 0)) * tmp;
-    *(results + 1) += (*(svars + i*2 + 1)) * tmp;
+  for (r = 1; r <= BSP_POLY_ORD; r++) {
+    for (j = BSP_POLY_ORD; j >= r; j--) {
+      int lo = u[j + k - BSP_POLY_ORD], hi = u[j + 1 + k - r];
+      double alpha = (hi == lo) ? 0.0 : (intv - lo) / (hi - lo);
+      d[j][0] = (1.0 - alpha) * d[j-1][0] + alpha * d[j][0];
+      d[j][1] = (1.0 - alpha) * d[j-1][1] + alpha * d[j][1];
+      }
     }
+  *(results + 0) = d[BSP_POLY_ORD][0];
+  *(results + 1) = d[BSP_POLY_ORD][1];
 }
 
 /******************************************************************************
@@ -103,27 +83,26 @@ static void bsp_compute_point(int * u, int size, double intv, double * svars, do
 
 int bspline(double * svars, uint16_t size, double * results) {
   double increment = (double) (size - BSP_POLY_ORD)/(BSP_NUM_OUTP - 1);
-  double * lastp   = (double *) malloc(2 * sizeof(double));  
   double interval  = 0.0;
-  int i;
-  int * u = (int *) malloc((size + BSP_POLY_ORD + 1) * sizeof(int));
+  int i, k = BSP_POLY_ORD;
+  int u[size + BSP_POLY_ORD + 1];  // knot vector; size is 16bit, so at most 256kB of stack
 
-  if (! bsp_compute_intervals(u, size)) {
-    free(lastp);
+  if (! bsp_compute_intervals(u, size))
     return 0;
-    }
 
   for (i = 0; i < (BSP_NUM_OUTP) - 1; i++) {
-    bsp_compute_point(u, size, interval, svars, lastp);
-    *(results + i*2 + 0) = *(lastp + 0);
-    *(results + i*2 + 1) = *(lastp + 1);
+    // interval only grows, so does the knot span.
+    while ((k < size - 1) && (interval >= u[k+1]))
+      k++;
+    if ((u[k] <= interval) && (interval < u[k+1]))
+      bsp_compute_point(u, k, interval, svars, results + i*2);
+    else
+      *(results + i*2 + 0) = *(results + i*2 + 1) = 0.0;
     interval += increment;
     }
    // put in the last point
   *(results + (BSP_NUM_OUTP - 1)*2 + 0) = *(svars + (size - 1) * 2 + 0);
   *(results + (BSP_NUM_OUTP - 1)*2 + 1) = *(svars + (size - 1) * 2 + 1);
-  free(u);
-  free(lastp);
   return 1;
 }
 
@@ -213,86 +192,71 @@ int csp_reqbufsize (int size) {
  *****************************************************************************/
 
 int cspline (double * svars, uint16_t size, double * results) {
-  double * coeff;
-  int coeff_rows = csp_reqbufsize(size);     
-  int srow = 0;
-  int row = 0, col = 0;
-  int start, stop;
-  int retval = 0;
+  /* natural spline: the second derivatives m[i] at the inner samples are the
+   * solution of a tridiagonal system, solved by the Thomas algorithm in O(n).
+   * Each segment is then converted to a*x^3 + b*x^2 + c*x + d.
+   */
+  int n = size - 1;
+  double * h, * m, * diag, * rhs;
+  int i;
+
+  if (size < 2)
+    return -1;
+
+  memset(results, 0, csp_reqbufsize(size) * sizeof(double));
 
   // allocate memory
-  if (! (coeff = (double *) malloc(coeff_rows * (coeff_rows + 1) * sizeof(double)))) {
+  if (! (h = (double *) malloc(4 * size * sizeof(double)))) {
     printf("%s: could not allocate memory.", __FUNCTION__);
     return -1;
     }
-
-  memset(coeff,   0, coeff_rows * (coeff_rows + 1) * sizeof(double));
-  memset(results, 0, coeff_rows * sizeof(double));
-
-  // now start assigning values
-
-  // (I)
-  row = 0; col = 0; srow = 0;
-  nextquad(6 * *(svars + srow * 2), 2, 0, 0);
-
-  // (II)
-  row = 1; col = coeff_rows - 4; srow = size - 1;
-  nextquad(6 * *(svars + srow * 2), 2, 0, 0);
-
-  // (III) .. (V)
-  start = 2; stop = start + (size - 2); col = 0; srow = 1;
-  for (row = start; row < stop; row++) {
-    nextquad( 6 * *(svars + srow * 2),  2, 0, 0);
-    nextquad(-6 * *(svars + srow * 2), -2, 0, 0);
-    col -= 4;
-    srow++;
+  m    = h + size;
+  diag = m + size;
+  rhs  = diag + size;
+
+  #define X(i) *(svars + (i) * 2 + 0)
+  #define Y(i) *(svars + (i) * 2 + 1)
+  for (i = 0; i < n; i++) {
+    h[i] = X(i+1) - X(i);
+    if (fabs(h[i]) < 1e-12) {
+      printf("%s: could not solve matrix.", __FUNCTION__);
+      free(h);
+      return -1;
+      }
     }
 
-  // (VI) .. (VIII)
-  start = row; stop = start + (size - 2); col = 0; srow = 1;
-  for (row = start; row < stop; row++) {
-    nextquad( 3 * pow(*(svars + srow * 2),2),  2 * *(svars + srow * 2),  1, 0);
-    nextquad(-3 * pow(*(svars + srow * 2),2), -2 * *(svars + srow * 2), -1, 0);
-    col -= 4;
-    srow++;
+  // forward elimination; sub- and superdiagonal of row i are h[i-1] and h[i].
+  m[0] = m[n] = 0.0;
+  for (i = 1; i < n; i++) {
+    diag[i] = 2 * (h[i-1] + h[i]);
+    rhs[i]  = 6 * ((Y(i+1) - Y(i)) / h[i] - (Y(i) - Y(i-1)) / h[i-1]);
+    if (i > 1) {
+      double f = h[i-1] / diag[i-1];
+      diag[i] -= f * h[i-1];
+      rhs[i]  -= f * rhs[i-1];
+      }
     }
-
-  // (IX)
-  col = 0; srow = 0;
-  nextquad(pow(*(svars + srow * 2),3), pow(*(svars + srow * 2),2), *(svars + srow * 2), 1);
-  nextres(*(svars + srow * 2 + 1));
-  row++;
-
-  // (X)
-  col = coeff_rows - 4; srow = size - 1;
-  nextquad(pow(*(svars + srow * 2),3), pow(*(svars + srow * 2),2), *(svars + srow * 2), 1);
-  nextres(*(svars + srow * 2 + 1));
-  row++;
-
-  // (XI) .. (XVI)
-  start = row; stop = start + 2*(size - 2); col = 0; srow = 1;
-  for (row = start; row < stop; row++) {
-    nextquad(pow(*(svars + srow * 2),3), pow(*(svars + srow * 2),2), *(svars + srow * 2), 1);
-    nextres(*(svars + srow * 2 + 1));
-    row++;
-    nextquad(pow(*(svars + srow * 2),3), pow(*(svars + srow * 2),2), *(svars + srow * 2), 1);
-    nextres(*(svars + srow * 2 + 1));
-    col -= 4;
-    srow++;
+  // back substitution
+  for (i = n - 1; i > 0; i--)
+    m[i] = (rhs[i] - h[i] * m[i+1]) / diag[i];
+
+  for (i = 0; i < n; i++) {
+    double x0 = X(i), x1 = X(i+1);
+    double A  = m[i]   / (6 * h[i]);
+    double B  = m[i+1] / (6 * h[i]);
+    double C  = Y(i)   / h[i] - m[i]   * h[i] / 6;
+    double D  = Y(i+1) / h[i] - m[i+1] * h[i] / 6;
+    // f(x) = A*(x1-x)^3 + B*(x-x0)^3 + C*(x1-x) + D*(x-x0)
+    *(results + i*4 + 0) = B - A;
+    *(results + i*4 + 1) = 3 * (A * x1 - B * x0);
+    *(results + i*4 + 2) = 3 * (B * x0 * x0 - A * x1 * x1) + D - C;
+    *(results + i*4 + 3) = A * x1 * x1 * x1 - B * x0 * x0 * x0 + C * x1 - D * x0;
     }
+  #undef X
+  #undef Y
 
-  dprint("==== coeff ====\n");  
-  #if EXT_M_DEBUG
-  printmatrix (coeff, coeff_rows + 1, coeff_rows, 0);
-  #endif
-
-  if (! linearsolve (coeff, coeff_rows, results)) {
-     printf("%s: could not solve matrix.", __FUNCTION__);     
-     retval = -1;
-     }
-
-  free(coeff);
-  return retval;
+  free(h);
+  return 0;
 }
 
 #define EPSILON 0.00001
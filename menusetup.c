@@ -207,7 +207,7 @@ void stopScanners(void) {
   }
 
 ///! DoScan(int DVB_Type), call this one to create new scanner.
-bool DoScan(int DVB_Type) {
+bool DoScan(int DVB_Type, bool Warm) {
   if (Scanner && Scanner->Active())
      return false;
 
@@ -219,7 +219,7 @@ bool DoScan(int DVB_Type) {
 
   timestamp = time(0);
   channelcount = Channels.Count();
-  Scanner = new cScanner(ScannerDesc, (scantype_t) DVB_Type);
+  Scanner = new cScanner(ScannerDesc, (scantype_t) DVB_Type, Warm || wSetup.warm_start);
   return true;
 }
 
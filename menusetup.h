@@ -25,7 +25,7 @@ extern int lStrength;
 extern int channelcount;
 
 void stopScanners(void);
-bool DoScan (int DVB_Type);
+bool DoScan (int DVB_Type, bool Warm = false);  // Warm: seed from transponder cache, see cTransponderCache
 void DoStop (void);
 
 class cMenuScanning : public cMenuSetupPage {
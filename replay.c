@@ -0,0 +1,396 @@
+/*
+ * replay.c: wirbelscan - A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ * $Id$
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/dvb/frontend.h>
+#include <vdr/sources.h>
+#include "replay.h"
+#include "scanfilter.h"
+#include "common.h"
+
+#define REPLAY_LOCK_TIME                      300 //ms until lock at Speed 1
+
+cReplayDevice *          cReplayDevice::devices[MAXDEVICES] = { NULL };
+cList<cReplayDevice::cRecording> cReplayDevice::recordings;
+
+//--------cReplayDevice-----------------------------------------------------------------------
+
+// "<source>-<frequency>[<polarization>].ts", see replay.h
+bool cReplayDevice::Parse(const char * FileName, int &Source, int &Frequency, char &Polarization) {
+  const char * dash = strrchr(FileName, '-');
+  const char * ext  = strrchr(FileName, '.');
+  char *       p;
+
+  if (!dash || !ext || strcmp(ext, ".ts")) {
+    return (false);
+    }
+  cString s = cString::sprintf("%.*s", (int) (dash - FileName), FileName);
+  if (!(Source = cSource::FromString(*s))) {
+    return (false);
+    }
+  Frequency    = strtol(dash + 1, &p, 10);
+  Polarization = 0;
+  if (p < ext) {
+    Polarization = toupper(*p);
+    }
+  return (Frequency > 0);
+  }
+
+int cReplayDevice::Create(const char * Directory, int Speed) {
+  const char * types = "TCSA";
+  int count = 0;
+  DIR * d = opendir(Directory);
+
+  if (!d) {
+    dlog(0, "replay: could not open %s", Directory);
+    return (0);
+    }
+  struct dirent * e;
+  while ((e = readdir(d)) != NULL) {
+    cRecording * r = new cRecording;
+    if (!Parse(e->d_name, r->source, r->frequency, r->polarization)) {
+      delete r;
+      continue;
+      }
+    r->fileName = AddDirectory(Directory, e->d_name);
+    r->bad      = false;
+    recordings.Add(r);
+    }
+  closedir(d);
+
+  for (const char * t = types; *t; t++) {
+    for (cRecording * r = recordings.First(); r; r = recordings.Next(r)) {
+      if ((r->source & cSource::st_Mask) == (uint) (*t << 24)) {
+        cReplayDevice * dev = new cReplayDevice(*t, Speed);
+        dlog(1, "replay: device %d = %s", dev->CardIndex(), *dev->Name());
+        count++;
+        break;
+        }
+      }
+    }
+  dlog(1, "replay: %d recordings in %s", recordings.Count(), Directory);
+  return (count);
+  }
+
+cReplayDevice * cReplayDevice::Get(int CardIndex) {
+  if ((CardIndex < 0) || (CardIndex >= MAXDEVICES)) {
+    return (NULL);
+    }
+  return (devices[CardIndex]);
+  }
+
+cReplayDevice::cReplayDevice(char Type, int Speed) {
+  type      = Type;
+  speed     = Speed;
+  recording = NULL;
+  file      = NULL;
+  fed       = false;
+  restart   = false;
+  if (CardIndex() < MAXDEVICES) {
+    devices[CardIndex()] = this;
+    }
+  StartSectionHandler();
+  feeder = new cFeeder(this);
+  feeder->Start();
+  }
+
+cReplayDevice::~cReplayDevice() {
+  feeder->Stop();
+  delete feeder;
+  for (cReplayFilter * f = filters.First(); f; f = filters.Next(f)) {
+    close(f->fd);
+    }
+  if (file) {
+    fclose(file);
+    }
+  if (CardIndex() < MAXDEVICES) {
+    devices[CardIndex()] = NULL;
+    }
+  }
+
+cReplayDevice::cRecording * cReplayDevice::GetRecording(const cChannel * Channel) const {
+  sTransponderKey k;
+
+  GetTransponderKey(Channel, k);
+  for (cRecording * r = recordings.First(); r; r = recordings.Next(r)) {
+    if (r->source != k.source) {
+      continue;
+      }
+    if (k.type == 'S') {
+      if ((r->polarization != toupper(k.polarization)) || (abs(r->frequency - k.frequency) >= 2)) {
+        continue;
+        }
+      }
+    else if (abs(r->frequency - k.frequency) >= 2001) {
+      continue;
+      }
+    return (r);
+    }
+  return (NULL);
+  }
+
+bool cReplayDevice::ProvidesSource(int Source) const {
+  return ((Source & cSource::st_Mask) == (uint) (type << 24));
+  }
+
+bool cReplayDevice::ProvidesTransponder(const cChannel * Channel) const {
+  return (ProvidesSource(Channel->Source()));
+  }
+
+bool cReplayDevice::ProvidesChannel(const cChannel * Channel, int Priority, bool * NeedsDetachReceivers) const {
+  if (NeedsDetachReceivers) {
+    *NeedsDetachReceivers = false;
+    }
+  return (ProvidesTransponder(Channel));
+  }
+
+bool cReplayDevice::SetChannelDevice(const cChannel * Channel, bool LiveView) {
+  cMutexLock lock(&mutex);
+  recording = GetRecording(Channel);
+  restart   = true;
+  tuned.Set();
+  return (true);
+  }
+
+bool cReplayDevice::HasLock(int TimeoutMs) {
+  int lockTime = speed ? REPLAY_LOCK_TIME / speed : 0;
+
+  mutex.Lock();
+  bool has = (recording != NULL);
+  int wait = lockTime - (int) tuned.Elapsed();
+  mutex.Unlock();
+  if (!has) {
+    return (false);
+    }
+  if (wait > 0) {
+    if (TimeoutMs < wait) {
+      return (false);
+      }
+    cCondWait::SleepMs(wait);
+    }
+  return (true);
+  }
+
+int cReplayDevice::OpenFilter(u_short Pid, u_char Tid, u_char Mask) {
+  cMutexLock lock(&mutex);
+  int sv[2];
+
+  // SEQPACKET keeps section boundaries, as a demux filter would do.
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+    dlog(0, "replay: socketpair failed: %s", strerror(errno));
+    return (-1);
+    }
+  fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+  cReplayFilter * f = new cReplayFilter;
+  f->fd   = sv[1];
+  f->pid  = Pid;
+  f->tid  = Tid;
+  f->mask = Mask;
+  filters.Add(f);
+
+  cAssembler * a;
+  for (a = assemblers.First(); a; a = assemblers.Next(a))
+    if (a->pid == Pid)
+      break;
+  if (!a) {
+    a = new cAssembler;
+    a->pid    = Pid;
+    a->length = -1;
+    assemblers.Add(a);
+    }
+  return (sv[0]);
+  }
+
+// feeds one ts packet of the current recording. false, if there is nothing to feed.
+bool cReplayDevice::Feed(uint64_t &Packets) {
+  cMutexLock lock(&mutex);
+  uchar buf[188];
+
+  if (restart) {
+    restart = false;
+    if (file) {
+      fclose(file);
+      file = NULL;
+      }
+    for (cAssembler * a = assemblers.First(); a; a = assemblers.Next(a))
+      a->length = -1;
+    fed = false;
+    if (recording && !recording->bad && !(file = fopen(*recording->fileName, "r"))) {
+      dlog(0, "replay: could not open %s", *recording->fileName);
+      }
+    }
+  if (!file || !filters.Count() || !HasLock()) {
+    Packets = 0;
+    return (false);
+    }
+  if (fread(buf, sizeof(buf), 1, file) != 1) {
+    if (!fed) {
+      // a whole pass without a single packet; don't spin on it.
+      dlog(0, "replay: no ts packets in %s", *recording->fileName);
+      recording->bad = true;
+      fclose(file);
+      file    = NULL;
+      Packets = 0;
+      return (false);
+      }
+    fed = false;
+    rewind(file);    // start over, like a carousel
+    return (true);
+    }
+  if (buf[0] != 0x47) {
+    // lost sync: search next sync byte
+    int c;
+    while ((c = fgetc(file)) != EOF && c != 0x47);
+    if (c == 0x47)
+      fseek(file, -1, SEEK_CUR);
+    return (true);
+    }
+  Packet(buf);
+  fed = true;
+  Packets++;
+  return (true);
+  }
+
+// collects sections from ts packets, see ISO/IEC 13818-1 2.4.4
+void cReplayDevice::Packet(const uchar * Data) {
+  u_short      pid = ((Data[1] & 0x1F) << 8) | Data[2];
+  cAssembler * a;
+  int          p = 4;
+
+  if (Data[1] & 0x80) {
+    return;      // transport error
+    }
+  for (a = assemblers.First(); a; a = assemblers.Next(a))
+    if (a->pid == pid)
+      break;
+  if (!a || !(Data[3] & 0x10)) {
+    return;      // not filtered or no payload
+    }
+  if (Data[3] & 0x20) {
+    p += 1 + Data[4];
+    }
+  if (p >= 188) {
+    return;
+    }
+  if (Data[1] & 0x40) {
+    int pointer = Data[p++];
+    if ((a->length > 0) && (pointer > 0) && (p + pointer <= 188)) {
+      memcpy(a->data + a->length, Data + p, pointer);
+      a->length += pointer;
+      }
+    a->length = max(a->length, 0);
+    p += pointer;
+    // the rest of a previous section, if any, is complete now.
+    while (a->length >= 3) {
+      int l = 3 + (((a->data[1] & 0x0F) << 8) | a->data[2]);
+      if (a->length < l)
+        break;
+      Section(pid, a->data, l);
+      memmove(a->data, a->data + l, a->length - l);
+      a->length -= l;
+      }
+    a->length = 0;
+    }
+  else if (a->length < 0) {
+    return;      // not yet in sync
+    }
+  if (p >= 188) {
+    return;
+    }
+  memcpy(a->data + a->length, Data + p, 188 - p);
+  a->length += 188 - p;
+  while (a->length >= 3) {
+    if (a->data[0] == 0xFF) {
+      a->length = 0;   // stuffing up to the end of the packet
+      break;
+      }
+    int l = 3 + (((a->data[1] & 0x0F) << 8) | a->data[2]);
+    if (l > 4096) {
+      a->length = -1;  // garbage, wait for next section start
+      break;
+      }
+    if (a->length < l)
+      break;
+    Section(pid, a->data, l);
+    memmove(a->data, a->data + l, a->length - l);
+    a->length -= l;
+    }
+  }
+
+void cReplayDevice::Section(u_short Pid, const uchar * Data, int Length) {
+  cReplayFilter * next;
+
+  for (cReplayFilter * f = filters.First(); f; f = next) {
+    next = filters.Next(f);
+    if ((f->pid != Pid) || ((Data[0] & f->mask) != (f->tid & f->mask))) {
+      continue;
+      }
+    if (send(f->fd, Data, Length, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+      if (errno == EAGAIN) {
+        continue;  // reader too slow: lost, as on a real demux
+        }
+      // vdr closed its end of this filter.
+      close(f->fd);
+      filters.Del(f);
+      }
+    }
+  }
+
+unsigned int cReplayDevice::FeType(void) const {
+  switch (type) {
+     case 'T': return (FE_OFDM);
+     case 'C': return (FE_QAM);
+     case 'S': return (FE_QPSK);
+     default:  return (FE_ATSC);
+     }
+  }
+
+unsigned int cReplayDevice::Capabilities(void) const {
+  unsigned int caps = FE_CAN_INVERSION_AUTO | FE_CAN_FEC_AUTO | FE_CAN_QAM_AUTO |
+                      FE_CAN_TRANSMISSION_MODE_AUTO | FE_CAN_BANDWIDTH_AUTO |
+                      FE_CAN_GUARD_INTERVAL_AUTO | FE_CAN_HIERARCHY_AUTO;
+  #if (DVB_API_VERSION >= 5)
+  if (type == 'S')
+    caps |= FE_CAN_2G_MODULATION;
+  if (type == 'A')
+    caps |= FE_CAN_8VSB | FE_CAN_QAM_256;
+  #endif
+  return (caps);
+  }
+
+cString cReplayDevice::Name(void) const {
+  return cString::sprintf("wirbelscan replay (%c)", type);
+  }
+
+//--------cReplayDevice::cFeeder--------------------------------------------------------------
+
+void cReplayDevice::cFeeder::Action(void) {
+  uint64_t packets = 0;
+  cTimeMs  start;
+
+  while (Running()) {
+    if (!device->Feed(packets)) {
+      cCondWait::SleepMs(10);
+      continue;
+      }
+    if (packets == 1) {
+      start.Set();
+      }
+    else if (device->speed && !(packets & 63)) {
+      int ahead = (int) (packets * 1000 / (REPLAY_PACKETS_PER_SEC * device->speed)) - (int) start.Elapsed();
+      if (ahead > 0)
+        cCondWait::SleepMs(ahead);
+      }
+    }
+  }
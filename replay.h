@@ -0,0 +1,100 @@
+/*
+ * replay.h: wirbelscan - A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ * $Id$
+ */
+
+#ifndef __WIRBELSCAN_REPLAY_H_
+#define __WIRBELSCAN_REPLAY_H_
+
+#include <vdr/device.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+/* A device without hardware, to reproduce scans on a build machine.
+ * Each transponder is a transport stream recording in one directory,
+ * named by source and frequency as returned by FormatFreq():
+ *
+ *    T-474000.ts         DVB-T  474MHz   (kHz)
+ *    C-346000.ts         DVB-C  346MHz   (kHz)
+ *    A-57000.ts          ATSC   57MHz    (kHz)
+ *    S19.2E-11836H.ts    DVB-S  11836MHz (MHz) + polarization
+ *
+ * A transponder has lock, if there is a recording for it. Its sections
+ * are fed to the section filters at Speed times a nominal bitrate of
+ * 38Mbit/s (Speed 0: as fast as possible), starting over at the end of
+ * the file like a broadcast carousel.
+ */
+
+#define REPLAY_PACKETS_PER_SEC                25270 // 38Mbit/s, 188 bytes per packet
+
+class cReplayDevice : public cDevice {
+private:
+  class cRecording : public cListObject {
+public:
+    int     source;
+    int     frequency;
+    char    polarization;
+    cString fileName;
+    bool    bad;           // has no ts packet at all, already logged
+    };
+  class cReplayFilter : public cListObject {
+public:
+    int     fd;          // our end of the socket pair
+    u_short pid;
+    u_char  tid;
+    u_char  mask;
+    };
+  class cAssembler : public cListObject {
+public:
+    u_short pid;
+    int     length;
+    uchar   data[4096 + 188];
+    };
+  class cFeeder : public cThread {
+private:
+    cReplayDevice * device;
+protected:
+    virtual void Action(void);
+public:
+    cFeeder(cReplayDevice * Device) : cThread("wirbelscan replay") { device = Device; };
+    void Stop(void) { Cancel(3); };
+    };
+  static cReplayDevice * devices[MAXDEVICES];
+  static cList<cRecording> recordings;
+  char                 type;          // 'T', 'C', 'S' or 'A'
+  int                  speed;
+  cMutex               mutex;
+  cRecording *         recording;     // of the current transponder, NULL if none
+  FILE *               file;
+  bool                 fed;           // a packet was fed since the file was (re)started
+  bool                 restart;       // transponder switched, start over
+  cTimeMs              tuned;
+  cList<cReplayFilter> filters;
+  cList<cAssembler>    assemblers;
+  cFeeder *            feeder;
+  static bool Parse(const char * FileName, int &Source, int &Frequency, char &Polarization);
+  cRecording * GetRecording(const cChannel * Channel) const;
+  bool Feed(uint64_t &Packets);
+  void Packet(const uchar * Data);
+  void Section(u_short Pid, const uchar * Data, int Length);
+protected:
+  virtual bool SetChannelDevice(const cChannel * Channel, bool LiveView);
+  virtual int  OpenFilter(u_short Pid, u_char Tid, u_char Mask);
+public:
+  cReplayDevice(char Type, int Speed);
+  virtual ~cReplayDevice();
+  virtual bool ProvidesSource(int Source) const;
+  virtual bool ProvidesTransponder(const cChannel * Channel) const;
+  virtual bool ProvidesChannel(const cChannel * Channel, int Priority = -1, bool * NeedsDetachReceivers = NULL) const;
+  virtual bool HasLock(int TimeoutMs = 0);
+  unsigned int FeType(void) const;
+  unsigned int Capabilities(void) const;
+  cString      Name(void) const;
+  static int   Create(const char * Directory, int Speed);   // one device per delivery system found, returns their count
+  static cReplayDevice * Get(int CardIndex);                // NULL, if CardIndex isn't a replay device
+  };
+
+#endif
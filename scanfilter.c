@@ -21,20 +21,28 @@
 #include <vdr/sources.h>
 #include <vdr/tools.h>
 #include <vdr/config.h>
+#include <vdr/plugin.h>
 #include "scanfilter.h"
 #include "common.h"
 #include "dvb_wrapper.h"
 #include "menusetup.h"
 #include "si_ext.h"
+#include "scanstats.h"
 
 using namespace SI_EXT;
 
-cChannels     NewChannels;
+cNewChannels  NewChannels;
 cTransponders NewTransponders;
 cTransponders ScannedTransponders;
 int           nextTransponders;
+cMutex        ScanListMutex;
+cTransponderQueue TransponderQueue;
+cTableVersions TableVersions;
+cScanTimer    ScanTimer;
 
 void resetLists() {
+  cMutexLock lock(&ScanListMutex);
+  TransponderQueue.Clear();
   NewChannels.Load(NULL, false, false);
   NewTransponders.Load(NULL, false, false);
   ScannedTransponders.Load(NULL, false, false);
@@ -51,67 +59,74 @@ int FormatFreq(int f) {
   return (f);
   }
 
+static bool is_nearly_same_frequency(const sTransponderKey &a, const sTransponderKey &b, uint delta = 2001) {
+  uint32_t diff = (a.frequency > b.frequency) ? (a.frequency - b.frequency) : (b.frequency - a.frequency);
+  return (diff < delta);
+  }
+
+// true, if channel from a list is the same (initial) transponder as newChannel.
+static bool is_same_initial_transponder(const cChannel * channel, const sTransponderKey &c,
+                                        const cChannel * newChannel, const sTransponderKey &n, bool auto_allowed) {
+  if (channel->GroupSep()) {
+    return (false);
+    }
+  if (c.source != n.source) {
+    return (false);
+    }
+  switch (n.type) {
+    case 'T':
+      return (is_nearly_same_frequency(c, n));
+    case 'C':
+      if (newChannel->Ca() != 0xA1) {
+        return (is_nearly_same_frequency(c, n));
+        }
+      return ((channel->Ca() == newChannel->Ca()) && is_nearly_same_frequency(c, n, 50));
+    case 'A':
+      return (is_nearly_same_frequency(c, n) && (c.modulation == n.modulation));
+    case 'S':
+      return (!is_different_transponder_deep_scan(n, c, auto_allowed));
+    default:;
+    }
+  if (IsPvrinput(newChannel)) {
+    if (is_nearly_same_frequency(c, n) &&
+        #if VDRVERSNUM > 10712
+        ! strcmp(channel->Parameters(), newChannel->Parameters())) {
+        #elif defined (PLUGINPARAMPATCHVERSNUM)
+        ! strcmp(channel->PluginParam(), newChannel->PluginParam())) {
+        #else
+        // remove "true) {", as soon as plugin param patch removed.
+        true) {
+        #endif
+      return (true);
+      }
+    }
+  return (false);
+  }
+
 bool is_known_initial_transponder(cChannel * newChannel, bool auto_allowed, cChannels * list) {
+  cMutexLock lock(&ScanListMutex);
   dlog(4, "%s", __FUNCTION__);
   if (list == NULL) {
-    return (is_known_initial_transponder(newChannel, auto_allowed, &NewTransponders) ||
-            is_known_initial_transponder(newChannel, auto_allowed, &ScannedTransponders));
+    return (NewTransponders.IsKnown(newChannel, auto_allowed) ||
+            ScannedTransponders.IsKnown(newChannel, auto_allowed));
     }
 
+  sTransponderKey n, c;
+  GetTransponderKey(newChannel, n);
   for (cChannel * channel = list->First(); channel; channel = list->Next(channel)) {
-    if (channel->GroupSep()) {
-      continue;
-      }
-    if (newChannel->IsTerr()) {
-      if ((channel->Source() == newChannel->Source()) && is_nearly_same_frequency(channel, newChannel)) {
-        return (true);
-        }
-      }
-    if (newChannel->IsCable()) {
-      if (newChannel->Ca() != 0xA1) {
-        if ((channel->Source() == newChannel->Source()) && is_nearly_same_frequency(channel, newChannel)) {
-          return (true);
-          }
-        }
-      else {
-        if ((channel->Ca() == newChannel->Ca()) && (channel->Source() == newChannel->Source()) &&
-            is_nearly_same_frequency(channel, newChannel, 50)) {
-          return (true);
-          }
-        }
-      }
-#if VDRVERSNUM > 10713
-    if (newChannel->IsAtsc()) {
-      cDvbTransponderParameters * p  = new cDvbTransponderParameters(channel->Parameters());
-      cDvbTransponderParameters * pn = new cDvbTransponderParameters(newChannel->Parameters());
-      if ((channel->Source() == newChannel->Source()) && is_nearly_same_frequency(channel, newChannel) &&
-          (p->Modulation() == pn->Modulation())) {
-        return (true);
-        }
-      }
-#endif
-    if (IsPvrinput(newChannel)) {
-      if ((channel->Source() == newChannel->Source()) && is_nearly_same_frequency(channel, newChannel) &&
-          #if VDRVERSNUM > 10712
-          ! strcmp(channel->Parameters(), newChannel->Parameters())) {
-          #elif defined (PLUGINPARAMPATCHVERSNUM)
-          ! strcmp(channel->PluginParam(), newChannel->PluginParam())) {
-          #else
-          // remove "true) {", as soon as plugin param patch removed.
-          true) {
-          #endif
-        return (true);
-        }
-      }
-    if (newChannel->IsSat()) {
-      if (!is_different_transponder_deep_scan(newChannel, channel, auto_allowed)) {
-        return (true);
-        }
+    GetTransponderKey(channel, c);
+    if (is_same_initial_transponder(channel, c, newChannel, n, auto_allowed)) {
+      return (true);
       }
     }
   return (false);
   }
 
+bool is_known_initial_transponder(cChannel * newChannel, bool auto_allowed, cTransponders * list) {
+  cMutexLock lock(&ScanListMutex);
+  return (list->IsKnown(newChannel, auto_allowed));
+  }
+
 bool is_nearly_same_frequency(const cChannel * chan_a, const cChannel * chan_b, uint delta) {
   uint32_t diff;
   int      f1 = FormatFreq(chan_a->Frequency());
@@ -130,192 +145,879 @@ bool is_nearly_same_frequency(const cChannel * chan_a, const cChannel * chan_b,
   return (false);
   }
 
+void GetTransponderKey(const cChannel * Transponder, sTransponderKey &Key) {
+  memset(&Key, 0, sizeof(Key));
+  Key.source    = Transponder->Source();
+  Key.frequency = FormatFreq(Transponder->Frequency());
+  Key.srate     = Transponder->Srate();
+  if      (Transponder->IsSat())   Key.type = 'S';
+  else if (Transponder->IsCable()) Key.type = 'C';
+  else if (Transponder->IsTerr())  Key.type = 'T';
+#if VDRVERSNUM > 10713
+  else if (Transponder->IsAtsc())  Key.type = 'A';
+#endif
+#if VDRVERSNUM < 10713
+  Key.modulation   = Transponder->Modulation();
+  Key.bandwidth    = Transponder->Bandwidth();
+  Key.coderateH    = Transponder->CoderateH();
+  Key.coderateL    = Transponder->CoderateL();
+  Key.hierarchy    = Transponder->Hierarchy();
+  Key.transmission = Transponder->Transmission();
+  Key.guard        = Transponder->Guard();
+  Key.polarization = Transponder->Polarization();
+#if VDRVERSNUM >= 10700
+  Key.system       = Transponder->System();
+  Key.rolloff      = Transponder->RollOff();
+#endif
+#else
+  cDvbTransponderParameters p(Transponder->Parameters());
+  Key.modulation   = p.Modulation();
+  Key.bandwidth    = p.Bandwidth();
+  Key.coderateH    = p.CoderateH();
+  Key.coderateL    = p.CoderateL();
+  Key.hierarchy    = p.Hierarchy();
+  Key.transmission = p.Transmission();
+  Key.guard        = p.Guard();
+  Key.polarization = p.Polarization();
+  Key.system       = p.System();
+  Key.rolloff      = p.RollOff();
+#endif
+  }
+
 bool is_different_transponder_deep_scan(const cChannel * a, const cChannel * b, bool auto_allowed) {
-#define IS_DIFFERENT(A, B, _ALLOW_AUTO_, _AUTO_)    ((A != B) && (!_ALLOW_AUTO_ || (_ALLOW_AUTO_ && (A != _AUTO_) && (B != _AUTO_))))
+  sTransponderKey ak, bk;
 
-  int maxdelta = 2001;
+  GetTransponderKey(a, ak);
+  GetTransponderKey(b, bk);
+  return (is_different_transponder_deep_scan(ak, bk, auto_allowed));
+  }
 
-  if (a->IsSat()) maxdelta = 2;
+bool is_different_transponder_deep_scan(const sTransponderKey &a, const sTransponderKey &b, bool auto_allowed) {
+#define IS_DIFFERENT(A, B, _ALLOW_AUTO_, _AUTO_)    ((A != B) && (!_ALLOW_AUTO_ || (_ALLOW_AUTO_ && (A != _AUTO_) && (B != _AUTO_))))
 
-  dlog(4, "%s", __FUNCTION__);
-  if (a->Source() != b->Source()) {
+  if (a.source != b.source) {
     return (true);
     }
 
-  if (!is_nearly_same_frequency(a, b, maxdelta)) {
+  if (!is_nearly_same_frequency(a, b, (a.type == 'S') ? 2 : 2001)) {
     return (true);
     }
-#if VDRVERSNUM < 10713
-  if (a->IsTerr()) {
-    if (IS_DIFFERENT(a->Modulation(), b->Modulation(), auto_allowed, QAM_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(a->Bandwidth(), b->Bandwidth(), auto_allowed, BANDWIDTH_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(a->CoderateH(), b->CoderateH(), auto_allowed, FEC_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(a->Hierarchy(), b->Hierarchy(), auto_allowed, HIERARCHY_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(a->CoderateL(), b->CoderateL(), auto_allowed, FEC_AUTO)) {
-      return (true);
+  switch (a.type) {
+    case 'T':
+      if (IS_DIFFERENT(a.modulation, b.modulation, auto_allowed, QAM_AUTO)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.bandwidth, b.bandwidth, auto_allowed, BANDWIDTH_AUTO)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.coderateH, b.coderateH, auto_allowed, FEC_AUTO)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.hierarchy, b.hierarchy, auto_allowed, HIERARCHY_AUTO)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.coderateL, b.coderateL, auto_allowed, FEC_AUTO)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.transmission, b.transmission, auto_allowed, TRANSMISSION_MODE_AUTO)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.guard, b.guard, auto_allowed, GUARD_INTERVAL_AUTO)) {
+        return (true);
+        }
+      return (false);
+    case 'A':
+      if (IS_DIFFERENT(a.modulation, b.modulation, auto_allowed, QAM_AUTO)) {
+        return (true);
+        }
+      return (false);
+    case 'C':
+      if (IS_DIFFERENT(a.modulation, b.modulation, auto_allowed, QAM_AUTO)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.srate, b.srate, false, 6900)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.coderateH, b.coderateH, auto_allowed, FEC_AUTO)) {
+        return (true);
+        }
+      return (false);
+    case 'S':
+      if (IS_DIFFERENT(a.srate, b.srate, false, 27500)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.polarization, b.polarization, false, 0)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.coderateH, b.coderateH, auto_allowed, FEC_AUTO)) {
+        return (true);
+        }
+#if VDRVERSNUM >= 10700
+      if (IS_DIFFERENT(a.system, b.system, false, 0)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.rolloff, b.rolloff, auto_allowed, ROLLOFF_35)) {
+        return (true);
+        }
+      if (IS_DIFFERENT(a.modulation, b.modulation, auto_allowed, QPSK)) {
+        return (true);
+        }
+#endif
+      return (false);
+    default:;
+    }
+  dlog(0, "%s: unknown source type", __FUNCTION__);
+  return (true);
+  }
+
+//--------cTransponder-------------------------------------------------------------------------
+
+cTransponders::cTransponders(void) {
+  memset(index, 0, sizeof(index));
+  serials = 0;
+  }
+
+cTransponders::~cTransponders() {
+  ClearIndex();
+  }
+
+int cTransponders::Bucket(const sTransponderKey &Key) {
+  return (Key.frequency / ((Key.type == 'S') ? _BUCKETWIDTH_SAT : _BUCKETWIDTH));
+  }
+
+uint cTransponders::Hash(const sTransponderKey &Key, int Bucket) {
+  uint h = (uint) Key.source * 31 + (uint) Bucket;
+  // polarization is part of the key only for sat, see is_different_transponder_deep_scan()
+  if (Key.type == 'S')
+    h = h * 31 + (uchar) Key.polarization;
+  return (h ^ (h >> 10)) & (_INDEXSIZE - 1);
+  }
+
+void cTransponders::Index(cChannel * Transponder) {
+  cIndexEntry * e = new cIndexEntry;
+  GetTransponderKey(Transponder, e->key);
+  e->transponder = Transponder;
+  e->bucket      = Bucket(e->key);
+  e->serial      = serials++;
+  e->hasSignal   = false;
+  uint h         = Hash(e->key, e->bucket);
+  e->next        = index[h];
+  index[h]       = e;
+  }
+
+cTransponders::cIndexEntry * cTransponders::Entry(const cChannel * Transponder) {
+  for (int h = 0; h < _INDEXSIZE; h++) {
+    for (cIndexEntry * e = index[h]; e; e = e->next) {
+      if (e->transponder == Transponder)
+        return e;
       }
-    if (IS_DIFFERENT(a->Transmission(), b->Transmission(), auto_allowed, TRANSMISSION_MODE_AUTO)) {
-      return (true);
+    }
+  return NULL;
+  }
+
+void cTransponders::Unindex(const cChannel * Transponder) {
+  // the key may have changed since indexing, therefore search all chains.
+  for (int h = 0; h < _INDEXSIZE; h++) {
+    for (cIndexEntry ** e = &index[h]; *e; e = &(*e)->next) {
+      if ((*e)->transponder == Transponder) {
+        cIndexEntry * found = *e;
+        *e = found->next;
+        delete found;
+        return;
+        }
       }
-    if (IS_DIFFERENT(a->Guard(), b->Guard(), auto_allowed, GUARD_INTERVAL_AUTO)) {
-      return (true);
+    }
+  }
+
+void cTransponders::ClearIndex(void) {
+  for (int h = 0; h < _INDEXSIZE; h++) {
+    while (index[h]) {
+      cIndexEntry * e = index[h];
+      index[h] = e->next;
+      delete e;
       }
-    return (false);
     }
-  if (a->IsCable()) {
-    if (IS_DIFFERENT(a->Modulation(), b->Modulation(), auto_allowed, QAM_AUTO)) {
-      return (true);
+  serials = 0;
+  }
+
+void cTransponders::Clear(void) {
+  cMutexLock lock(&ScanListMutex);
+  ClearIndex();
+  cChannels::Clear();
+  }
+
+void cTransponders::Add(cChannel * Transponder) {
+  cMutexLock lock(&ScanListMutex);
+  cChannels::Add(Transponder);
+  Index(Transponder);
+  }
+
+void cTransponders::Update(cChannel * Transponder) {
+  cMutexLock lock(&ScanListMutex);
+  sSignalStats signal;
+  bool hasSignal = GetSignal(Transponder, &signal);
+  Unindex(Transponder);
+  Index(Transponder);
+  if (hasSignal)
+    SetSignal(Transponder, signal);
+  }
+
+void cTransponders::SetSignal(const cChannel * Transponder, const sSignalStats &Signal) {
+  cMutexLock lock(&ScanListMutex);
+  cIndexEntry * e = Entry(Transponder);
+  if (e) {
+    e->signal    = Signal;
+    e->hasSignal = true;
+    }
+  }
+
+bool cTransponders::GetSignal(const cChannel * Transponder, sSignalStats * Signal) {
+  cMutexLock lock(&ScanListMutex);
+  cIndexEntry * e = Entry(Transponder);
+  if (!e || !e->hasSignal)
+    return false;
+  *Signal = e->signal;
+  return true;
+  }
+
+// returns the first listed transponder (in order of adding) for which Match() is true.
+// Only the buckets which may hold a transponder close enough to Channel are searched.
+cChannel * cTransponders::Find(const cChannel * Channel, bool (*Match)(const cChannel * Entry, const sTransponderKey &EntryKey,
+                               const cChannel * Channel, const sTransponderKey &ChannelKey, bool auto_allowed), bool auto_allowed) {
+  cIndexEntry * best = NULL;
+  sTransponderKey key;
+
+  GetTransponderKey(Channel, key);
+  int bucket = Bucket(key);
+  for (int b = bucket - 1; b <= bucket + 1; b++) {
+    for (cIndexEntry * e = index[Hash(key, b)]; e; e = e->next) {
+      if ((e->bucket != b) || (e->key.source != key.source) ||
+          ((key.type == 'S') && (e->key.polarization != key.polarization))) {
+        continue;
+        }
+      if ((best != NULL) && (best->serial < e->serial)) {
+        continue;
+        }
+      if (Match(e->transponder, e->key, Channel, key, auto_allowed)) {
+        best = e;
+        }
       }
-    if (IS_DIFFERENT(a->Srate(), b->Srate(), false, 6900)) {
-      return (true);
+    }
+  return (best ? best->transponder : NULL);
+  }
+
+static bool is_same_transponder_params(const cChannel * Entry, const sTransponderKey &EntryKey,
+                                       const cChannel * Channel, const sTransponderKey &ChannelKey, bool auto_allowed) {
+  return (!is_different_transponder_deep_scan(EntryKey, ChannelKey, auto_allowed));
+  }
+
+bool cTransponders::IsKnown(const cChannel * NewChannel, bool auto_allowed) {
+  cMutexLock lock(&ScanListMutex);
+  return (Find(NewChannel, is_same_initial_transponder, auto_allowed) != NULL);
+  }
+
+cChannel * cTransponders::GetByParams(const cChannel * NewTransponder) {
+  cMutexLock lock(&ScanListMutex);
+  dlog(4, "%s(%s)", __FUNCTION__, *PrintTransponder(NewTransponder));
+  return (Find(NewTransponder, is_same_transponder_params, true));
+  }
+
+bool cTransponders::IsUniqueTransponder(const cChannel * NewTransponder) {
+  return (GetByParams(NewTransponder) == NULL);
+  }
+
+//--------cNewChannels------------------------------------------------------------------------
+
+cNewChannels::cNewChannels(void) {
+  memset(index, 0, sizeof(index));
+  serials = 0;
+  }
+
+cNewChannels::~cNewChannels() {
+  ClearIndex();
+  }
+
+uint cNewChannels::Hash(int Source, int Sid) {
+  uint h = (uint) Source * 31 + (uint) Sid;
+  return (h ^ (h >> 10)) & (_INDEXSIZE - 1);
+  }
+
+void cNewChannels::ClearIndex(void) {
+  for (int h = 0; h < _INDEXSIZE; h++) {
+    while (index[h]) {
+      cIndexEntry * e = index[h];
+      index[h] = e->next;
+      delete e;
       }
-    if (IS_DIFFERENT(a->CoderateH(), b->CoderateH(), auto_allowed, FEC_AUTO)) {
-      return (true);
+    }
+  serials = 0;
+  }
+
+void cNewChannels::Clear(void) {
+  cMutexLock lock(&ScanListMutex);
+  ClearIndex();
+  cChannels::Clear();
+  }
+
+void cNewChannels::Add(cChannel * Channel) {
+  cMutexLock lock(&ScanListMutex);
+  cIndexEntry * e = new cIndexEntry;
+  uint h     = Hash(Channel->Source(), Channel->Sid());
+  e->channel = Channel;
+  e->serial  = serials++;
+  e->next    = index[h];
+  index[h]   = e;
+  cChannels::Add(Channel);
+  }
+
+void cNewChannels::Del(cChannel * Channel, bool DeleteObject) {
+  cMutexLock lock(&ScanListMutex);
+  for (cIndexEntry ** e = &index[Hash(Channel->Source(), Channel->Sid())]; *e; e = &(*e)->next) {
+    if ((*e)->channel == Channel) {
+      cIndexEntry * found = *e;
+      *e = found->next;
+      delete found;
+      break;
       }
-    return (false);
     }
-  if (a->IsSat()) {
-    if (IS_DIFFERENT(a->Srate(), b->Srate(), false, 27500)) {
-      return (true);
+  cChannels::Del(Channel, DeleteObject);
+  }
+
+// same as cChannels::GetByServiceID(), but independent of vdr's channel hash.
+cChannel * cNewChannels::GetByServiceID(int Source, int Transponder, unsigned short ServiceID) {
+  cMutexLock lock(&ScanListMutex);
+  cIndexEntry * best = NULL;
+
+  for (cIndexEntry * e = index[Hash(Source, ServiceID)]; e; e = e->next) {
+    cChannel * ch = e->channel;
+    if ((best != NULL) && (best->serial < e->serial)) {
+      continue;
       }
-    if (IS_DIFFERENT(a->Polarization(), b->Polarization(), false, 0)) {
-      return (true);
+    if ((ch->Sid() == ServiceID) && (ch->Source() == Source) && ISTRANSPONDER(ch->Transponder(), Transponder)) {
+      best = e;
       }
-    if (IS_DIFFERENT(a->CoderateH(), b->CoderateH(), auto_allowed, FEC_AUTO)) {
-      return (true);
+    }
+  return (best ? best->channel : NULL);
+  }
+
+// first service with Source, Tid and Sid. If Transponder is given, the
+// service has also to be within MaxDelta of Transponder's frequency.
+cChannel * cNewChannels::GetByService(int Source, int Tid, int Sid, const cChannel * Transponder, uint MaxDelta) {
+  cMutexLock lock(&ScanListMutex);
+  cIndexEntry * best = NULL;
+
+  for (cIndexEntry * e = index[Hash(Source, Sid)]; e; e = e->next) {
+    cChannel * ch = e->channel;
+    if ((best != NULL) && (best->serial < e->serial)) {
+      continue;
       }
-#if VDRVERSNUM >= 10700
-    if (IS_DIFFERENT(a->System(), b->System(), false, 0)) {
-      return (true);
+    if ((ch->Sid() == Sid) && (ch->Source() == Source) && (ch->Tid() == Tid) &&
+        (!Transponder || is_nearly_same_frequency(ch, Transponder, MaxDelta))) {
+      best = e;
       }
-    if (IS_DIFFERENT(a->RollOff(), b->RollOff(), auto_allowed, ROLLOFF_35)) {
-      return (true);
+    }
+  return (best ? best->channel : NULL);
+  }
+
+// adds a transponder found by Owner's filters to NewTransponders and queues it for scan.
+static void AddNewTransponder(cChannel * Transponder, int Owner) {
+  cMutexLock lock(&ScanListMutex);
+  NewTransponders.Add(Transponder);
+  nextTransponders = NewTransponders.Count() - ScannedTransponders.Count();
+  TransponderQueue.Push(Owner, Transponder);
+  }
+
+//--------cTransponderQueue-------------------------------------------------------------------
+
+cTransponderQueue::cTransponderQueue(void) {
+  busy  = 0;
+  count = 0;
+  }
+
+void cTransponderQueue::Push(int Owner, cChannel * Transponder) {
+  cMutexLock lock(&mutex);
+  if (Owner < 0 || Owner >= MAXDEVICES)
+    Owner = 0;
+  deques[Owner].Add(new cItem(Transponder));
+  count++;
+  changed.Broadcast();
+  }
+
+cChannel * cTransponderQueue::Pop(int Owner) {
+  cMutexLock lock(&mutex);
+  cItem *    item = NULL;
+  cChannel * transponder;
+
+  if (Owner >= 0 && Owner < MAXDEVICES)
+    item = deques[Owner].First();
+  if (item == NULL) {
+    int victim = -1;
+    for (int i = 0; i < MAXDEVICES; i++)
+      if (deques[i].Count() && (victim < 0 || deques[i].Count() > deques[victim].Count()))
+        victim = i;
+    if (victim < 0)
+      return (NULL);
+    item = deques[victim].Last();
+    dlog(4, "   device %d: stealing from device %d", Owner, victim);
+    deques[victim].Del(item, false);
+    }
+  else
+    deques[Owner].Del(item, false);
+  count--;
+  transponder = item->transponder;
+  delete item;
+  return (transponder);
+  }
+
+int cTransponderQueue::Count(void) {
+  cMutexLock lock(&mutex);
+  return (count);
+  }
+
+void cTransponderQueue::Clear(void) {
+  cMutexLock lock(&mutex);
+  for (int i = 0; i < MAXDEVICES; i++)
+    deques[i].Clear();
+  count = 0;
+  busy  = 0;  // a scan device cancelled during the last scan may not have said goodbye.
+  }
+
+void cTransponderQueue::SetBusy(bool On) {
+  cMutexLock lock(&mutex);
+  busy += On ? 1 : -1;
+  changed.Broadcast();
+  }
+
+bool cTransponderQueue::Idle(int TimeoutMs) {
+  cMutexLock lock(&mutex);
+  if (!count && busy)
+    changed.TimedWait(mutex, TimeoutMs);
+  return (!count && !busy);
+  }
+
+//--------cSectionTracker---------------------------------------------------------------------
+
+void cSectionTracker::Reset(void) {
+  numSubTables = 0;
+  memset(&subTables, 0, sizeof(subTables));
+  }
+
+bool cSectionTracker::Add(u_char Tid, u_short Id, int Version, int Section, int LastSection) {
+  int        key = (Tid << 16) | Id;
+  cSubTable * t  = NULL;
+
+  for (int i = 0; i < numSubTables; i++) {
+    if (subTables[i].id == key) {
+      t = &subTables[i];
+      break;
       }
-    if (IS_DIFFERENT(a->Modulation(), b->Modulation(), auto_allowed, QPSK)) {
-      return (true);
+    }
+  if (t == NULL) {
+    if (numSubTables >= _MAXSUBTABLES) {
+      return (false);
       }
-#endif
+    t = &subTables[numSubTables++];
+    t->id      = key;
+    t->version = -1;
+    }
+  if (t->version != Version) {
+    // new subtable or version change: start over.
+    t->version     = Version;
+    t->wrapped     = false;
+    memset(&t->received, 0, sizeof(t->received));
+    }
+  t->lastSection = LastSection;
+  if (t->received[Section >> 3] & (1 << (Section & 7))) {
+    t->wrapped = true;
     return (false);
     }
-#else
-  cDvbTransponderParameters * ap = new cDvbTransponderParameters(a->Parameters());
-  cDvbTransponderParameters * bp = new cDvbTransponderParameters(b->Parameters());
-  if (a->IsTerr()) {
-    if (IS_DIFFERENT(ap->Modulation(), bp->Modulation(), auto_allowed, QAM_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->Bandwidth(), bp->Bandwidth(), auto_allowed, BANDWIDTH_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->CoderateH(), bp->CoderateH(), auto_allowed, FEC_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->Hierarchy(), bp->Hierarchy(), auto_allowed, HIERARCHY_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->CoderateL(), bp->CoderateL(), auto_allowed, FEC_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->Transmission(), bp->Transmission(), auto_allowed, TRANSMISSION_MODE_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->Guard(), bp->Guard(), auto_allowed, GUARD_INTERVAL_AUTO)) {
-      return (true);
-      }
+  t->received[Section >> 3] |= (1 << (Section & 7));
+  return (true);
+  }
+
+bool cSectionTracker::Complete(void) {
+  if (numSubTables == 0 || numSubTables >= _MAXSUBTABLES) {
     return (false);
     }
-#if VDRVERSNUM > 10713
-  if (a->IsAtsc()) {
-    if (IS_DIFFERENT(ap->Modulation(), bp->Modulation(), auto_allowed, QAM_AUTO)) {
-      return (true);
+  for (int i = 0; i < numSubTables; i++) {
+    for (int n = 0; n <= subTables[i].lastSection; n++) {
+      if (! (subTables[i].received[n >> 3] & (1 << (n & 7)))) {
+        return (false);
+        }
       }
+    }
+  return (true);
+  }
+
+bool cSectionTracker::Wrapped(void) {
+  if (! Complete()) {
     return (false);
     }
-#endif
-  if (a->IsCable()) {
-    if (IS_DIFFERENT(ap->Modulation(), bp->Modulation(), auto_allowed, QAM_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(a->Srate(), b->Srate(), false, 6900)) {
-      return (true);
+  for (int i = 0; i < numSubTables; i++) {
+    if (! subTables[i].wrapped) {
+      return (false);
       }
-    if (IS_DIFFERENT(ap->CoderateH(), bp->CoderateH(), auto_allowed, FEC_AUTO)) {
+    }
+  return (true);
+  }
+
+//--------cTableVersions--------------------------------------------------------------------
+
+cTableVersion::cTableVersion(void) {
+  source = onid = tsid = 0;
+  nit = pat = sdt = pmt = -1;
+  }
+
+bool cTableVersion::Parse(const char * s) {
+  char src[32];
+
+  pmt = -1; // lines without pmt are from older versions of the plugin.
+  if (6 > sscanf(s, "%31[^:]:%d:%d:%d:%d:%d:%d", src, &onid, &tsid, &nit, &pat, &sdt, &pmt))
+    return (false);
+  return ((source = cSource::FromString(src)) != 0);
+  }
+
+bool cTableVersion::Save(FILE * f) {
+  return (fprintf(f, "%s:%d:%d:%d:%d:%d:%d\n", *cSource::ToString(source), onid, tsid, nit, pat, sdt, pmt) > 0);
+  }
+
+cTableVersion * cTableVersions::Get(int Source, int Onid, int Tsid) {
+  for (cTableVersion * v = First(); v; v = Next(v))
+    if ((v->source == Source) && (v->onid == Onid) && (v->tsid == Tsid))
+      return (v);
+  return (NULL);
+  }
+
+bool cTableVersions::HasSource(int Source) {
+  for (cTableVersion * v = First(); v; v = Next(v))
+    if (v->source == Source)
       return (true);
-      }
+  return (false);
+  }
+
+void cTableVersions::Set(int Source, int Onid, int Tsid, int Nit, int Pat, int Sdt, int Pmt) {
+  cTableVersion * v = Get(Source, Onid, Tsid);
+
+  if (!v) {
+    v = new cTableVersion;
+    v->source = Source;
+    v->onid   = Onid;
+    v->tsid   = Tsid;
+    Add(v);
+    }
+  v->nit = Nit;
+  v->pat = Pat;
+  v->sdt = Sdt;
+  v->pmt = Pmt;
+  }
+
+//--------cTransponderCache------------------------------------------------------------------
+
+cString cTransponderCache::FileName(int Type, const char * List) {
+  const char * types = "TCS??A";
+
+  return AddDirectory(cPlugin::ConfigDirectory("wirbelscan"),
+                      cString::sprintf("transponders-%c-%s.conf", types[constrain(Type, 0, 5)], List));
+  }
+
+bool cTransponderCache::Load(int Type, const char * List) {
+  return (cConfig<cChannel>::Load(*FileName(Type, List), false, false) && Count());
+  }
+
+bool cTransponderCache::Save(int Type, const char * List, cTransponders * Transponders) {
+  cSafeFile f(*FileName(Type, List));
+  sSignalStats signal;
+  bool result = true;
+
+  if (!f.Open())
     return (false);
+  for (cChannel * t = Transponders->First(); t && result; t = Transponders->Next(t)) {
+    if (!Transponders->GetSignal(t, &signal) || !(signal.status & FE_HAS_LOCK))
+      continue;
+    cChannel c(*t);
+    c.SetName("wirbelscan", "", "");  // channels.conf syntax needs a name
+    result = c.Save(f);
     }
-  if (a->IsSat()) {
-    if (IS_DIFFERENT(a->Srate(), b->Srate(), false, 27500)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->Polarization(), bp->Polarization(), false, 0)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->CoderateH(), bp->CoderateH(), auto_allowed, FEC_AUTO)) {
-      return (true);
-      }
-    if (IS_DIFFERENT(ap->System(), bp->System(), false, 0)) {
-      return (true);
+  return (f.Close() && result);
+  }
+
+//--------cScanTimer--------------------------------------------------------------------------
+
+cDeadline::cDeadline(void) {
+  deadline = 0;
+  next     = NULL;
+  }
+
+cDeadline::~cDeadline() {
+  // derived classes should already have done so, as Expired() is theirs.
+  ClearDeadline(true);
+  }
+
+void cDeadline::SetDeadline(int Ms) {
+  ScanTimer.Del(this, false);
+  started.Set();
+  deadline = cTimeMs::Now() + Ms;
+  ScanTimer.Add(this);
+  }
+
+void cDeadline::ExtendDeadline(int Ms) {
+  ScanTimer.Del(this, false);
+  deadline = cTimeMs::Now() + Ms;
+  ScanTimer.Add(this);
+  }
+
+void cDeadline::ClearDeadline(bool Wait) {
+  ScanTimer.Del(this, Wait);
+  }
+
+cScanTimer::cScanTimer(void) : cThread("wirbelscan timer") {
+  deadlines = NULL;
+  expiring  = NULL;
+  }
+
+void cScanTimer::Remove(cDeadline * Deadline) {
+  for (cDeadline ** d = &deadlines; *d; d = &(*d)->next) {
+    if (*d == Deadline) {
+      *d = Deadline->next;
+      Deadline->next = NULL;
+      return;
       }
-    if (IS_DIFFERENT(ap->RollOff(), bp->RollOff(), auto_allowed, ROLLOFF_35)) {
-      return (true);
+    }
+  }
+
+void cScanTimer::Add(cDeadline * Deadline) {
+  mutex.Lock();
+  Deadline->next = deadlines;
+  deadlines      = Deadline;
+  changed.Broadcast();
+  mutex.Unlock();
+  }
+
+void cScanTimer::Del(cDeadline * Deadline, bool Wait) {
+  mutex.Lock();
+  Remove(Deadline);
+  while (Wait && (expiring == Deadline)) {
+    changed.Wait(mutex);
+    }
+  mutex.Unlock();
+  }
+
+void cScanTimer::Stop(void) {
+  Cancel(-1);
+  mutex.Lock();
+  changed.Broadcast();
+  mutex.Unlock();
+  Cancel(3);
+  }
+
+void cScanTimer::Action(void) {
+  mutex.Lock();
+  while (Running()) {
+    uint64_t    now  = cTimeMs::Now();
+    uint64_t    next = now + 1000;
+    cDeadline * d;
+
+    for (d = deadlines; d; d = d->next) {
+      if (d->deadline <= now) {
+        break;
+        }
+      if (d->deadline < next) {
+        next = d->deadline;
+        }
       }
-    if (IS_DIFFERENT(ap->Modulation(), bp->Modulation(), auto_allowed, QPSK)) {
-      return (true);
+    if (d) {
+      Remove(d);
+      expiring = d;
+      mutex.Unlock();
+      d->Expired();
+      mutex.Lock();
+      expiring = NULL;
+      changed.Broadcast();
+      continue;
       }
-    return (false);
+    changed.TimedWait(mutex, (int) (next - now));
     }
+  mutex.Unlock();
+  }
 
-#endif
-  dlog(0, "%s: unknown source type", __FUNCTION__);
-  return (true);
+//--------cVersionScanner---------------------------------------------------------------------
+
+cVersionScanner::cVersionScanner(void) {
+  active      = true;
+  source      = onid = tsid = 0;
+  pat         = sdt  = pmt  = -1;
+  numPmts     = nextPmt = pendingPmts = 0;
+  Set(0x00, 0x00);                          // PAT
+  Set(PID_SDT, TABLE_ID_SDT_ACTUAL, 0xFF);  // SDT actual
+  SetDeadline(2500);                        // SDT actual repeats at least every 2sec
   }
 
-//--------cTransponder-------------------------------------------------------------------------
+cVersionScanner::~cVersionScanner() {
+  ClearDeadline(true);
+  }
 
-cChannel * cTransponders::GetByParams(const cChannel * NewTransponder) {
-  dlog(4, "%s(%s)", __FUNCTION__, *PrintTransponder(NewTransponder));
-  if (Count() > 0) {
-    for (cChannel * tr = First(); tr; tr = Next(tr)) {
-      if (!is_different_transponder_deep_scan(tr, NewTransponder, true)) {
-        return (tr);
+void cVersionScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Length) {
+  ScanStats.Section();
+  if (!active) {
+    return;
+    }
+  source = Source();
+  if (Pid == 0x00) {
+    SI::PAT p(Data, false);
+    if ((pat >= 0) || !p.CheckCRCAndParse())
+      return;
+    if (p.getLastSectionNumber() > 0) {
+      // multi section PATs are rare; don't track them, always read them again.
+      dlog(4, "   versions: PAT has %d sections", p.getLastSectionNumber() + 1);
+      Done();
+      return;
+      }
+    pat  = p.getVersionNumber();
+    tsid = p.getTransportStreamId();
+    SI::PAT::Association assoc;
+    for (SI::Loop::Iterator it; p.associationLoop.getNext(assoc, it);) {
+      if (!assoc.getServiceId())
+        continue;
+      if (numPmts >= MAX_PMTS) {
+        Done();
+        return;
         }
+      pmts[numPmts].sid     = assoc.getServiceId();
+      pmts[numPmts].pid     = assoc.getPid();
+      pmts[numPmts].version = -1;
+      numPmts++;
       }
+    for (; (nextPmt < numPmts) && (pendingPmts < max(wSetup.pmt_filters, 1)); nextPmt++, pendingPmts++)
+      Set(pmts[nextPmt].pid, TABLE_ID_PMT);
+    }
+  else if (Tid == TABLE_ID_PMT) {
+    SI::PMT m(Data, false);
+    if (!m.CheckCRCAndParse())
+      return;
+    for (int i = 0; i < nextPmt; i++) {
+      if ((pmts[i].pid != Pid) || (pmts[i].sid != m.getServiceId()) || (pmts[i].version >= 0))
+        continue;
+      pmts[i].version = m.getVersionNumber();
+      Del(Pid, TABLE_ID_PMT);
+      pendingPmts--;
+      if (nextPmt < numPmts) {
+        Set(pmts[nextPmt++].pid, TABLE_ID_PMT);
+        pendingPmts++;
+        SetDeadline(2500);  // large transponders need several rounds of PMT filters.
+        }
+      break;
+      }
+    }
+  else {
+    SI::SDT s(Data, false);
+    if (s.CheckCRCAndParse() && (sdt < 0)) {
+      sdt  = s.getVersionNumber();
+      onid = s.getOriginalNetworkId();
+      if (tsid && (tsid != s.getTransportStreamId()))
+        sdt = -1;   // shouldn't happen, but don't trust it
+      }
+    }
+
+  if ((pat >= 0) && (sdt >= 0) && !Known()) {
+    // nothing to compare with, no need to wait for the PMTs.
+    dlog(4, "   versions: onid %d tsid %d not seen before (%dms)", onid, tsid, Elapsed());
+    Done();
+    return;
+    }
+  if ((pat >= 0) && (sdt >= 0) && (nextPmt == numPmts) && !pendingPmts) {
+    // order independent checksum over service ids and PMT versions.
+    unsigned int sum = numPmts;
+    for (int i = 0; i < numPmts; i++) {
+      unsigned int h = (pmts[i].sid << 5) | pmts[i].version;
+      h *= 0x9E3779B1;
+      sum += h ^ (h >> 15);
+      }
+    pmt = sum & 0x7FFFFFFF;
+    dlog(4, "   versions: onid %d tsid %d pat %d sdt %d pmt %d (%d PMTs, %dms)",
+         onid, tsid, pat, sdt, pmt, numPmts, Elapsed());
+    Done();
     }
-  return (NULL);
   }
 
-bool cTransponders::IsUniqueTransponder(const cChannel * NewTransponder) {
-  return (GetByParams(NewTransponder) == NULL);
+void cVersionScanner::Expired(void) {
+  dlog(4, "   versions: deadline");
+  active = false;
+  }
+
+bool cVersionScanner::Known(void) {
+  cMutexLock lock(&ScanListMutex);
+  return (TableVersions.Get(source, onid, tsid) != NULL);
+  }
+
+void cVersionScanner::Done(void) {
+  ClearDeadline();
+  active = false;
+  }
+
+bool cVersionScanner::Unchanged(void) {
+  cMutexLock lock(&ScanListMutex);
+  cTableVersion * v;
+
+  if ((pat < 0) || (sdt < 0) || (pmt < 0) || !(v = TableVersions.Get(source, onid, tsid)))
+    return (false);
+  return ((v->pat == pat) && (v->sdt == sdt) && (v->pmt == pmt));
+  }
+
+bool cVersionScanner::NitUnchanged(int Nit) {
+  cMutexLock lock(&ScanListMutex);
+  cTableVersion * v;
+
+  if (!(v = TableVersions.Get(source, onid, tsid)))
+    return (false);
+  return (v->nit == Nit);
+  }
+
+void cVersionScanner::Store(int Nit) {
+  cMutexLock lock(&ScanListMutex);
+
+  if ((pat < 0) || (sdt < 0))
+    return;
+  TableVersions.Set(source, onid, tsid, Nit, pat, sdt, pmt);
   }
 
 //--------cNitScanner-------------------------------------------------------------------------
 // basically this is cNitFilter from vdr/nit.{h,c} with some changes //
 
-cNitScanner::cNitScanner(int TableId) {
+cNitScanner::cNitScanner(int TableId, int Owner) {
   active    = true;
   tableId   = TableId;
+  owner     = Owner;
   numNits   = 0;
   networkId = 0;
-  syncNit.Reset();
-  Set(PID_NIT, tableId, 0xFF);     //network information section, actual or other network
-  Start();
+  version   = -1;
+  sections.Reset();
+  if (tableId == TABLE_ID_NIT_OTHER)
+     // NIT other may be missing at all. Watch the whole NIT pid carousel,
+     // to know when one full cycle of NIT sections has passed.
+     Set(PID_NIT, TABLE_ID_NIT_ACTUAL, 0xFE);
+  else
+     Set(PID_NIT, tableId, 0xFF);  //network information section, actual network
+  SetDeadline(12000);
   }
 
 void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Length) {
+  ScanStats.Section();
+  if (!active) {
+    return;
+    }
+  cMutexLock lock(&ScanListMutex);
   SI::NIT nit(Data, false);
-  if (!nit.CheckCRCAndParse() ||
-      !syncNit.Sync(nit.getVersionNumber(), nit.getSectionNumber(), nit.getLastSectionNumber())) {
+  if (!nit.CheckCRCAndParse()) {
+    return;
+    }
+  if (!sections.Add(Tid, nit.getNetworkId(), nit.getVersionNumber(), nit.getSectionNumber(), nit.getLastSectionNumber()) ||
+      Tid != tableId) {
+    Check();     // a repeated section may complete NIT other
     return;
     }
+  if (Tid == TABLE_ID_NIT_ACTUAL) {
+    version = nit.getVersionNumber();
+    }
 
   HEXDUMP(Data, Length);
   SI::NIT::TransportStream ts;
@@ -424,8 +1126,7 @@ void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
                    continue;
                    }
                  dlog(3, "   Add: %s -> NID = %d, TID = %d", *PrintTransponder(transponder), transponder->Nid(), transponder->Tid());
-                 NewTransponders.Add(transponder);
-                 nextTransponders = NewTransponders.Count() - ScannedTransponders.Count();
+                 AddNewTransponder(transponder, owner);
                  }
                else {
                  // we already know this transponder, lets update these channels
@@ -434,6 +1135,7 @@ void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
                    // only NIT_actual should update existing channels
                    if (is_different_transponder_deep_scan(transponder, update_transponder, false)) {
                      SetSatTransponderDataFromDVB(update_transponder, Source, Frequencies[n], Polarization, SymbolRate, CodeRate, ModulationType, System, RollOff);
+                     ScannedTransponders.Update(update_transponder);
                      dlog(2, "   Upd: %s", *PrintTransponder(update_transponder));
                      }
                    if ((ts.getOriginalNetworkId() != update_transponder->Nid()) ||
@@ -479,8 +1181,7 @@ void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
              if (SetCableTransponderDataFromDVB(transponder, Source, Frequencies[n], Modulation, SymbolRate, CodeRate, CableTerrInversions(eInversionAuto))) {
                if (!is_known_initial_transponder(transponder, true)) {
                  dlog(3, "   Add: %s -> NID = %d, TID = %d", *PrintTransponder(transponder), transponder->Nid(), transponder->Tid());
-                 NewTransponders.Add(transponder);
-                 nextTransponders = NewTransponders.Count() - ScannedTransponders.Count();
+                 AddNewTransponder(transponder, owner);
                  }
                else {
                  // we already know this transponder, lets update these channels
@@ -489,6 +1190,7 @@ void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
                    // only NIT_actual should update existing channels
                    if (is_different_transponder_deep_scan(transponder, update_transponder, false)) {
                      SetCableTransponderDataFromDVB(update_transponder, Source, Frequencies[n], Modulation, SymbolRate, CodeRate, 999);
+                     ScannedTransponders.Update(update_transponder);
                      dlog(2, "   Upd: %s", *PrintTransponder(update_transponder));
                      }
                    if ((ts.getOriginalNetworkId() != update_transponder->Nid()) ||
@@ -520,8 +1222,7 @@ void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
              if (SetTerrTransponderDataFromDVB(transponder, Source, Frequencies[n], Bandwidth, Constellation, Hierarchy, CodeRateHP, CodeRateLP, GuardInterval, TransmissionMode, CableTerrInversions(eInversionAuto))) {
                if (!is_known_initial_transponder(transponder, true)) {
                  dlog(3, "   Add: %s -> NID = %d, TID = %d", *PrintTransponder(transponder), transponder->Nid(), transponder->Tid());
-                 NewTransponders.Add(transponder);
-                 nextTransponders = NewTransponders.Count() - ScannedTransponders.Count();
+                 AddNewTransponder(transponder, owner);
                  }
                else {
                  // we already know this transponder, lets update these channels
@@ -530,6 +1231,7 @@ void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
                    // only NIT_actual should update existing channels
                    if (is_different_transponder_deep_scan(transponder, update_transponder, false)) {
                      SetTerrTransponderDataFromDVB(update_transponder, Source, Frequencies[n], Bandwidth, Constellation, Hierarchy, CodeRateHP, CodeRateLP, GuardInterval, TransmissionMode, 999);
+                     ScannedTransponders.Update(update_transponder);
                      dlog(2, "   Upd: %s", *PrintTransponder(update_transponder));
                      }
                    if ((ts.getOriginalNetworkId() != update_transponder->Nid()) ||
@@ -599,45 +1301,44 @@ void cNitScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
       DELETENULL(d);
       }
     }
+  Check();
   }
 
-void cNitScanner::Action(void) {
-  int count = 0;
-
-  while (Running() && active) {
-    cCondWait::SleepMs(10);
-    if (count++ > 1200) {     // 1200 x 10msec = 12sec
-      active = false;
-      }
+// section handler thread only.
+void cNitScanner::Check(void) {
+  if (!active || !(tableId == TABLE_ID_NIT_OTHER ? sections.Wrapped() : sections.Complete())) {
+    return;
     }
+  ClearDeadline();
+  dlog(4, "   NIT 0x%.2x: complete after %dms", tableId, Elapsed());
+  if (tableId == TABLE_ID_NIT_OTHER)
+    Del(PID_NIT, TABLE_ID_NIT_ACTUAL, 0xFE);
+  else
+    Del(PID_NIT, tableId);
   active = false;
-  Del(PID_NIT, tableId);
-  Cancel();
+  }
+
+void cNitScanner::Expired(void) {
+  dlog(4, "   NIT 0x%.2x: deadline", tableId);
+  active = false;   // filter is removed on Detach()
   }
 
 cNitScanner::~cNitScanner() {
-  while (active) cCondWait::SleepMs(50);
+  ClearDeadline(true);
   dlog(4, "   ~cNITscanner");
-  Cancel(10);
   }
 
 cChannel * GetByTransponder(const cChannel * Transponder) {
+  cMutexLock lock(&ScanListMutex);
   int maxdelta = 2001;
 
   if (Transponder->IsSat()) maxdelta = 2;
 
-  if (NewChannels.Count()) {
-    for (cChannel * ch = NewChannels.First(); ch; ch = NewChannels.Next(ch)) {
-      if (is_nearly_same_frequency(ch, Transponder, maxdelta) &&
-          ch->Source() == Transponder->Source() &&
-          ch->Tid() == Transponder->Tid() &&
-          ch->Sid() == Transponder->Sid()) {
-        dlog(4, "   GetByTransponder: known channel %s", *PrintChannel(Transponder));
-        return (ch);
-        }
-      }
+  cChannel * ch = NewChannels.GetByService(Transponder->Source(), Transponder->Tid(), Transponder->Sid(), Transponder, maxdelta);
+  if (ch) {
+    dlog(4, "   GetByTransponder: known channel %s", *PrintChannel(Transponder));
     }
-  return (NULL);
+  return (ch);
   }
 
 //--------cPatScanner-------------------------------------------------------------------------
@@ -645,26 +1346,32 @@ cChannel * GetByTransponder(const cChannel * Transponder) {
 cPatScanner::cPatScanner(cDevice * Parent) {
   parent = Parent;
   active = true;
-  memset(&cPmtScanners, 0, sizeof(cPmtScanners));
+  pmts   = NULL;
   Set(PID_PAT, TABLE_ID_PAT);
-  Start();
+  SetDeadline(1000);  // extended by cPmtScanner::Fill() for each new PMT pid
   }
 
 cPatScanner::~cPatScanner() {
+  ClearDeadline(true);
   active = false;
-  for (int i = 0; i < MAX_PMTS; i++)
-    if (cPmtScanners[i]) {
-      parent->Detach(cPmtScanners[i]);
-      }
-  Cancel();
+  if (pmts) {
+    parent->Detach(pmts);
+    DELETENULL(pmts);
+    }
   }
 
 void cPatScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Length) {
+  ScanStats.Section();
   if (!active) {
     return;
     }
+  cMutexLock lock(&ScanListMutex);
+  if (pmts) {
+    pmts->Rotate();  // PAT is repeated often enough to serve as clock here.
+    }
   SI::PAT tsPAT(Data, false);
-  if (!tsPAT.CheckCRCAndParse()) {
+  if (!tsPAT.CheckCRCAndParse() ||
+      !sections.Add(Tid, tsPAT.getTransportStreamId(), tsPAT.getVersionNumber(), tsPAT.getSectionNumber(), tsPAT.getLastSectionNumber())) {
     return;
     }
 
@@ -689,57 +1396,170 @@ void cPatScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
       }
     ch->SetName("???", "", "");
     if (!GetByTransponder(ch)) {
-      NewChannels.Lock(true, 100);
       NewChannels.Add(ch);
-      NewChannels.Unlock();
       dlog(1, "      Add: %s", *PrintChannel(ch));
-      for (int i = 0; i < MAX_PMTS; i++) {
-        if (!cPmtScanners[i]) {
-          cPmtScanners[i] = new cPmtScanner(ch, assoc.getServiceId(), assoc.getPid());
-          parent->AttachFilter(cPmtScanners[i]);
-          break;
-          }
+      if (!pmts) {
+        pmts = new cPmtScanner(this, wSetup.pmt_filters);
+        parent->AttachFilter(pmts);
         }
+      pmts->Add(ch, assoc.getServiceId(), assoc.getPid());
       }
     else {
-      free(ch);
+      delete ch;
       }
     }
+  Check();
   }
 
-void cPatScanner::Action(void) {
-  int count = 0;
-
-  while (Running() && active) {
-    cCondWait::SleepMs(10);
-    if (count++ > 100) { //1sec
-      active = false;
-      break;
-      }
+void cPatScanner::Check(void) {
+  if (!active || !sections.Complete() || !PmtsDone()) {
+    return;
     }
+  ClearDeadline();
+  dlog(4, "   PAT: complete after %dms", Elapsed());
   Del(PID_PAT, TABLE_ID_PAT);
+  active = false;
+  }
+
+void cPatScanner::Expired(void) {
+  dlog(4, "   PAT: deadline");
+  active = false;
+  }
+
+bool cPatScanner::PmtsDone(void) {
+  return (!pmts || pmts->Done());
   }
 
 //--------cPmtScanner-------------------------------------------------------------------------
 // basically this is cPatFilter from vdr/pat.{h,c} with some changes in Process()
 
-cPmtScanner::cPmtScanner(cChannel * channel, u_short Sid, u_short PmtPid) {
-  pmtPid  = PmtPid;
-  pmtSid  = Sid;
-  Channel = channel;
-  Set(pmtPid, TABLE_ID_PMT);     // PMT
+cPmtScanner::cPmtScanner(cPatScanner * Pat, int Budget) {
+  pat         = Pat;
+  numServices = 0;
+  numPids     = 0;
+  numOn       = 0;
+  budget      = constrain(Budget, 1, MAX_PMTS);
+  }
+
+bool cPmtScanner::Add(cChannel * Channel, u_short Sid, u_short PmtPid) {
+  cMutexLock lock(&ScanListMutex);
+  if (numServices >= MAX_PMTS) {
+    return (false);
+    }
+  cService * s = &services[numServices++];
+  s->channel = Channel;
+  s->sid     = Sid;
+  s->pid     = PmtPid;
+  s->done    = false;
+  for (int i = 0; i < numPids; i++)
+    if (pids[i].pid == PmtPid)
+      return (true);      // services sharing one PMT pid
+  pids[numPids].pid = PmtPid;
+  pids[numPids].on  = false;
+  numPids++;
+  Fill();
+  return (true);
+  }
+
+// true, if a service on Pid is still waiting for its PMT.
+bool cPmtScanner::Pending(u_short Pid) {
+  for (int i = 0; i < numServices; i++)
+    if (!services[i].done && (services[i].pid == Pid))
+      return (true);
+  return (false);
+  }
+
+void cPmtScanner::Remove(int Index) {
+  if (pids[Index].on) {
+    Del(pids[Index].pid, TABLE_ID_PMT);
+    numOn--;
+    }
+  memmove(&pids[Index], &pids[Index + 1], (numPids - Index - 1) * sizeof(cPmtPid));
+  numPids--;
+  }
+
+// starts filtering of waiting pids, as far as the budget allows.
+void cPmtScanner::Fill(void) {
+  bool started = false;
+
+  for (int i = 0; (i < numPids) && (numOn < budget); i++) {
+    if (!pids[i].on) {
+      Set(pids[i].pid, TABLE_ID_PMT);     // PMT
+      pids[i].on = true;
+      pids[i].since.Set();
+      numOn++;
+      started = true;
+      }
+    }
+  if (started)
+    pat->ExtendDeadline(2 * _PMT_TIMESLOT);  // give the new batch its time slot, and one retry of Rotate()
+  }
+
+void cPmtScanner::Rotate(void) {
+  cMutexLock lock(&ScanListMutex);
+  if (numOn >= numPids) {
+    return;       // nobody waiting
+    }
+  for (int i = 0, n = numPids; i < n;) {
+    if (pids[i].on && (pids[i].since.Elapsed() > _PMT_TIMESLOT)) {
+      cPmtPid p = pids[i];
+      Remove(i);
+      n--;
+      dlog(4, "   PMT: pid %d timed out, retry later", p.pid);
+      p.on = false;
+      pids[numPids++] = p;
+      }
+    else
+      i++;
+    }
+  Fill();
+  }
+
+void cPmtScanner::Done(cService * Service) {
+  Service->done = true;
+  if (!Pending(Service->pid)) {
+    for (int i = 0; i < numPids; i++) {
+      if (pids[i].pid == Service->pid) {
+        Remove(i);
+        break;
+        }
+      }
+    Fill();
+    }
+  pat->Check();
+  }
+
+bool cPmtScanner::Done(void) {
+  cMutexLock lock(&ScanListMutex);
+  for (int i = 0; i < numServices; i++)
+    if (!services[i].done)
+      return (false);
+  return (true);
   }
 
 void cPmtScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Length) {
+  ScanStats.Section();
+  cMutexLock lock(&ScanListMutex);
   SI::PMT pmt(Data, false);
-  if (!pmt.CheckCRCAndParse() ||
-      (pmt.getServiceId() != pmtSid)) {
+  if (!pmt.CheckCRCAndParse()) {
+    return;
+    }
+  cService * Service = NULL;
+  for (int i = 0; i < numServices; i++) {
+    if (!services[i].done && (services[i].pid == Pid) && (services[i].sid == pmt.getServiceId())) {
+      Service = &services[i];
+      break;
+      }
+    }
+  if (!Service) {
     return;
     }
   HEXDUMP(Data, Length);
 
-  if (Channel->Sid() != pmtSid) {
-    dlog(0, "ERROR: Channel->Sid(%d) != pmtSid(%d)", Channel->Sid(), pmtSid);
+  cChannel * Channel = Service->channel;
+  if (Channel->Sid() != Service->sid) {
+    dlog(0, "ERROR: Channel->Sid(%d) != pmtSid(%d)", Channel->Sid(), Service->sid);
+    Done(Service);
     return;
     }
   SI::CaDescriptor * d;
@@ -910,7 +1730,6 @@ void cPmtScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
       }
     }
   if (Vpid || Apids[0] || Dpids[0] || Tpid) {
-    Del(pmtPid, TABLE_ID_PMT);
     dlog(4, "      Upd: old  %s", *PrintChannel(Channel));
     SetPids(Channel, Vpid, Vpid ? Ppid : 0, Vpid ? Vtype : 0, Apids, Atypes, ALangs, Dpids, Dtypes, DLangs, Spids, SLangs, Tpid);
     Channel->SetCaIds(CaDescriptors->CaIds());
@@ -918,33 +1737,37 @@ void cPmtScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
     dlog(2, "      Upd: %s", *PrintChannel(Channel));
     }
   else {
-    Del(pmtPid, TABLE_ID_PMT);
     dlog(4, "   PMT: PmtPid=%.5d Sid=%d is invalid (no audio/video)", Pid, pmt.getServiceId());
     Channel->SetId(Channel->Nid(), Channel->Tid(), Channel->Sid(), INVALID_CHANNEL);
+    delete CaDescriptors;
     }
-  active = false;
-  return;
+  Done(Service);
   }
 
 // --- cSdtScanner ------------------------------------------------------------
 
-cSdtScanner::cSdtScanner(int TableId) {
+cSdtScanner::cSdtScanner(int TableId, int Owner, cPatScanner * Pat) {
   active  = true;
   tableId = TableId;
-  sectionSyncer.Reset();
+  owner   = Owner;
+  pat     = Pat;
+  patWait = (pat != NULL);
+  sections.Reset();
   Set(PID_SDT, tableId, 0xFF);     // SDT
-  Start();
+  SetDeadline(patWait ? 100 : 4000);  // 4sec, counted from the end of the PAT if running in parallel
   }
 
 void cSdtScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Length) {
-  if (!(Source() && Transponder())) {
+  ScanStats.Section();
+  if (!active || !(Source() && Transponder())) {
     return;
     }
+  cMutexLock lock(&ScanListMutex);
   SI::SDT sdt(Data, false);
-  if (!sdt.CheckCRCAndParse()) {
+  if (!sdt.CheckCRCAndParse() || PatPending(sdt)) {
     return;
     }
-  if (!sectionSyncer.Sync(sdt.getVersionNumber(), sdt.getSectionNumber(), sdt.getLastSectionNumber())) {
+  if (!sections.Add(Tid, sdt.getTransportStreamId(), sdt.getVersionNumber(), sdt.getSectionNumber(), sdt.getLastSectionNumber())) {
     return;
     }
   dlog(2, "   Transponder %d", Transponder());
@@ -953,27 +1776,15 @@ void cSdtScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
 
   SI::SDT::Service SiSdtService;
   for (SI::Loop::Iterator it; sdt.serviceLoop.getNext(SiSdtService, it);) {
-    cChannel * channel = NewChannels.First();
-    while (channel) {
-      if (channel->Source() == Source() &&
-          channel->Tid() == sdt.getTransportStreamId() &&
-          channel->Sid() == SiSdtService.getServiceId()) {
-        break;
-        }
-      channel = NewChannels.Next(channel);
-      }
-    if (!channel ||
-        channel->Source() != Source() ||
-        channel->Tid() != sdt.getTransportStreamId() ||
-        channel->Sid() != SiSdtService.getServiceId()) {
+    cChannel * channel = NewChannels.GetByService(Source(), sdt.getTransportStreamId(), SiSdtService.getServiceId());
+    if (!channel) {
       channel = new cChannel;
       channel->CopyTransponderData(Channel());
       if (!is_known_initial_transponder(channel, true)) {
         cChannel * transponder = new cChannel();
         transponder->CopyTransponderData(Channel());
         dlog(3, "   SDT: Add: %s", *PrintTransponder(transponder));
-        NewTransponders.Add(transponder);
-        nextTransponders = NewTransponders.Count() - ScannedTransponders.Count();
+        AddNewTransponder(transponder, owner);
         }
       channel->SetId(sdt.getOriginalNetworkId(), sdt.getTransportStreamId(), SiSdtService.getServiceId());
       channel->SetName("???", "", "");
@@ -1040,13 +1851,16 @@ void cSdtScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
                     }
                   }
                 else {
-                  channel = NewChannels.NewChannel(Channel(), pn, ps, pp, sdt.getOriginalNetworkId(), sdt.getTransportStreamId(), SiSdtService.getServiceId());
+                  channel = new cChannel;
+                  channel->CopyTransponderData(Channel());
+                  channel->SetName(pn, ps, pp);
+                  channel->SetId(sdt.getOriginalNetworkId(), sdt.getTransportStreamId(), SiSdtService.getServiceId());
+                  NewChannels.Add(channel);
                   if (!is_known_initial_transponder(channel, true)) {
                     cChannel * transponder = new cChannel();
                     transponder->CopyTransponderData(Channel());
                     dlog(3, "   SDT: Add: %s", *PrintTransponder(transponder));
-                    NewTransponders.Add(transponder);
-                    nextTransponders = NewTransponders.Count() - ScannedTransponders.Count();
+                    AddNewTransponder(transponder, owner);
                     }
                   dlog(2, "   SDT: Add %s", *PrintChannel(channel));
                   }
@@ -1074,31 +1888,99 @@ void cSdtScanner::Process(u_short Pid, u_char Tid, const u_char * Data, int Leng
       DELETENULL(d);
       }
     }
+  if (sections.Complete()) {
+    ClearDeadline();
+    dlog(4, "   SDT: complete after %dms", Elapsed());
+    Del(PID_SDT, tableId);
+    active = false;
+    }
   }
 
-void cSdtScanner::Action(void) {
-  int count = 0;
+// true, if the PAT running in parallel is not yet done and Sdt has services which it didn't add so far.
+// Such a section is left for one of its repetitions, as services should be added from PAT first.
+bool cSdtScanner::PatPending(SI::SDT & Sdt) {
+  if (!pat || !pat->Active()) {
+    return (false);
+    }
+  SI::SDT::Service SiSdtService;
+  for (SI::Loop::Iterator it; Sdt.serviceLoop.getNext(SiSdtService, it);) {
+    if (!NewChannels.GetByService(Source(), Sdt.getTransportStreamId(), SiSdtService.getServiceId())) {
+      return (true);
+      }
+    }
+  return (false);
+  }
 
-  while (Running() && active) {
-    cCondWait::SleepMs(10);
-    if (count++ > 400) { //2sec
-      active = false;
-      break;
+void cSdtScanner::Expired(void) {
+  if (patWait) {
+    // cPatScanner extends its deadline as long as PMTs come in, so poll it.
+    if (pat->Active()) {
+      ExtendDeadline(100);
+      return;
       }
+    patWait = false;
+    ExtendDeadline(4000);
+    return;
     }
+  dlog(4, "   SDT: deadline");
   active = false;
-  Del(PID_SDT, tableId);
-  Cancel(1);
   }
 
-cSdtScanner::~cSdtScanner() {}
+cSdtScanner::~cSdtScanner() {
+  ClearDeadline(true);
+  }
 
-int AddChannels() {
+// true, if Channel was found on Transponder.
+static bool IsOnTransponder(const cChannel * Channel, const cChannel * Transponder) {
+  if (Channel->Source() != Transponder->Source()) {
+    return (false);
+    }
+  if (Transponder->IsSat()) {
+    // includes polarization
+    return (abs(Channel->Transponder() - Transponder->Transponder()) < 2);
+    }
+  return (is_nearly_same_frequency(Channel, Transponder));
+  }
+
+// number of vdr's channels on Transponder, ie. from previous scans.
+int ServicesOnTransponder(const cChannel * Transponder) {
   int count = 0;
 
+  if (!Channels.Lock(false, 100)) {
+    return (0);
+    }
+  for (cChannel * Channel = Channels.First(); Channel; Channel = Channels.Next(Channel)) {
+    if (!Channel->GroupSep() && IsOnTransponder(Channel, Transponder)) {
+      count++;
+      }
+    }
+  Channels.Unlock();
+  return (count);
+  }
+
+/* adds the services found on Transponder to vdr's channel list and
+ * removes them from NewChannels. All services, if Transponder is NULL.
+ * Other services are left untouched, as they may be still in work
+ * by another device.
+ */
+int AddChannels(const cChannel * Transponder) {
+  cMutexLock      lock(&ScanListMutex);
+  cList<cChannel> Done;  // deletes its items on return
+  cChannel *      Next  = NULL;
+  int             count = 0;
+
+  for (cChannel * Channel = NewChannels.First(); Channel; Channel = Next) {
+    Next = NewChannels.Next(Channel);
+    if (Transponder && ! IsOnTransponder(Channel, Transponder)) {
+      continue;
+      }
+    NewChannels.Del(Channel, false);
+    Done.Add(Channel);
+    }
+
   Channels.IncBeingEdited();
 
-  for (cChannel * Channel = NewChannels.First(); Channel; Channel = NewChannels.Next(Channel)) {
+  for (cChannel * Channel = Done.First(); Channel; Channel = Done.Next(Channel)) {
     if (! Channel->Vpid() && ! Channel->Apid(0) && ! Channel->Dpid(0) && 
         ! Channel->Tpid() && ! Channel->Ca() &&
         ! strncasecmp(Channel->Name(),"???",3)) {
@@ -1186,7 +2068,6 @@ int AddChannels() {
     Channels.Add(aChannel);
     count++;
     }
-  NewChannels.Load(NULL, false, false);
   Channels.DecBeingEdited();
   Channels.ReNumber();
   Channels.SetModified(true);
@@ -1278,28 +2159,18 @@ cEitScanner::cEitScanner(void) {
   Set(PID_EIT, TABLE_ID_EIT_ACTUAL_PRESENT,        0xFE);  // actual(0x4E)/other(0x4F) TS, present/following
   Set(PID_EIT, TABLE_ID_EIT_ACTUAL_SCHEDULE_START, 0xF0);  // actual TS, schedule(0x50)/schedule for future days(0x5X)
   Set(PID_EIT, TABLE_ID_EIT_OTHER_SCHEDULE_START,  0xF0);  // other  TS, schedule(0x60)/schedule for future days(0x6X)
-  Start();
+  SetDeadline(10000);
 }
 
 void cEitScanner::Process(u_short Pid, u_char Tid, const u_char *Data, int Length) {
+  ScanStats.Section();
   cEitParser EitParser(Source(), Tid, Data);
 }
 
-void cEitScanner::Action(void) {
-  int count = 0;
-
-  while (Running() && active) {
-    cCondWait::SleepMs(10);
-    if (count++ > 1000) { //10sec
-      active = false;
-      break;
-      }
-    }
+void cEitScanner::Expired(void) {
   active = false;
-  Del(PID_EIT, TABLE_ID_EIT_ACTUAL_PRESENT);
-  Del(PID_EIT, TABLE_ID_EIT_ACTUAL_SCHEDULE_START);
-  Del(PID_EIT, TABLE_ID_EIT_OTHER_SCHEDULE_START);
-  Cancel(1);
   }
 
-cEitScanner::~cEitScanner() {}
+cEitScanner::~cEitScanner() {
+  ClearDeadline(true);
+  }
@@ -5,13 +5,17 @@
 #include <vdr/receiver.h>
 #include <vdr/filter.h>
 #include <vdr/pat.h>
+#include <vdr/config.h>
 #include <linux/dvb/frontend.h>
 #include "caDescriptor.h"
 #include "si_ext.h"
+#include "dvb_wrapper.h"
 
 #define _MAXNITS                              16
 #define _MAXNETWORKNAME                       Utf8BufSize(256)
 #define MAX_PMTS                              256 //max allowed PMTs per Transponder
+#define _PMT_TIMESLOT                         500 //ms a PMT pid stays filtered, if other pids are waiting
+#define _MAXSUBTABLES                         64  //max tracked subtables per cSectionTracker
 
 #define SCANNED_CHANNEL                       0x8000
 #define INVALID_CHANNEL                       0x4000
@@ -25,53 +29,316 @@
 #define HEXDUMP(d, l)
 #endif
 
+//---------sTransponderKey-------------------------------------------------------------------
+// transponder data parsed once from a cChannel, so that comparisons of transponders
+// don't need to parse Parameters() again for each compare.
+
+struct sTransponderKey {
+  int  source;
+  char type;          // 'S', 'C', 'T', 'A' (ATSC) or 0 if none of them
+  int  frequency;     // as returned by FormatFreq()
+  int  srate;
+  int  modulation;
+  int  bandwidth;
+  int  coderateH;
+  int  coderateL;
+  int  hierarchy;
+  int  transmission;
+  int  guard;
+  int  system;
+  int  rolloff;
+  char polarization;
+  };
+
+void GetTransponderKey(const cChannel * Transponder, sTransponderKey &Key);
+
 //---------cTransponders---------------------------------------------------------------------
+// list of transponders with an index on source (+ polarization for sat) and frequency.
+// Buckets are as wide as the max tolerance of is_nearly_same_frequency(), so any
+// matching transponder is found in the same or one of both neighbour buckets.
+
+#define _INDEXSIZE                            1024 //hash table size, power of 2
+#define _BUCKETWIDTH                          2001 //max delta used by is_nearly_same_frequency()
+#define _BUCKETWIDTH_SAT                      2    //max delta for sat, see is_different_transponder_deep_scan()
+
 class cTransponders : public cChannels {
 private:
+  class cIndexEntry {
+public:
+    cChannel *      transponder;
+    sTransponderKey key;
+    int             bucket;
+    int             serial;       // insertion order, to return the first match as a list search would do
+    bool            hasSignal;
+    sSignalStats    signal;       // frontend statistics after tuning
+    cIndexEntry *   next;
+    };
+  cIndexEntry * index[_INDEXSIZE];
+  int           serials;
+  cIndexEntry * Entry(const cChannel * Transponder);
+  static int  Bucket(const sTransponderKey &Key);
+  static uint Hash(const sTransponderKey &Key, int Bucket);
+  void Index(cChannel * Transponder);
+  void Unindex(const cChannel * Transponder);
+  void ClearIndex(void);
+  cChannel * Find(const cChannel * Channel, bool (*Match)(const cChannel * Entry, const sTransponderKey &EntryKey,
+                  const cChannel * Channel, const sTransponderKey &ChannelKey, bool auto_allowed), bool auto_allowed);
 protected:
 public:
+  cTransponders(void);
+  virtual ~cTransponders();
+  virtual void Clear(void);
+  void       Add(cChannel * Transponder);
+  void       Update(cChannel * Transponder);  // call after changing transponder data of a listed transponder
+  bool       IsKnown(const cChannel * NewChannel, bool auto_allowed);
   bool       IsUniqueTransponder(const cChannel * NewTransponder);
   cChannel * GetByParams(const cChannel * NewTransponder);
   cChannel * NextTransponder(void);
+  void       SetSignal(const cChannel * Transponder, const sSignalStats &Signal);
+  bool       GetSignal(const cChannel * Transponder, sSignalStats * Signal);
+  };
+
+//---------cNewChannels----------------------------------------------------------------------
+// list of services found while scanning, with a hash index on source and service id.
+
+class cNewChannels : public cChannels {
+private:
+  class cIndexEntry {
+public:
+    cChannel *    channel;
+    int           serial;       // insertion order, to return the first match as a list search would do
+    cIndexEntry * next;
+    };
+  cIndexEntry * index[_INDEXSIZE];
+  int           serials;
+  static uint Hash(int Source, int Sid);
+  void ClearIndex(void);
+public:
+  cNewChannels(void);
+  virtual ~cNewChannels();
+  virtual void Clear(void);
+  void       Add(cChannel * Channel);
+  void       Del(cChannel * Channel, bool DeleteObject = true);
+  cChannel * GetByServiceID(int Source, int Transponder, unsigned short ServiceID);
+  cChannel * GetByService(int Source, int Tid, int Sid, const cChannel * Transponder = NULL, uint MaxDelta = 2001);
   };
 
 extern cTransponders NewTransponders;
 extern cTransponders ScannedTransponders;
-extern cChannels     NewChannels;
+extern cNewChannels  NewChannels;
 extern int nextTransponders;
+extern cMutex        ScanListMutex;  // guards the lists above, if more than one device is scanning
+
+//---------cTransponderQueue-----------------------------------------------------------------
+// transponders from NewTransponders, which are waiting for scan. Each device
+// has its own deque, filled by its own NIT/SDT scanners. Devices with an empty
+// deque steal from the longest deque of the other devices.
+// Devices, which may still push transponders, are counted as busy.
+
+class cTransponderQueue {
+private:
+  class cItem : public cListObject {
+public:
+    cChannel * transponder;
+    cItem(cChannel * Transponder) { transponder = Transponder; };
+    };
+  cMutex       mutex;
+  cCondVar     changed;
+  cList<cItem> deques[MAXDEVICES];
+  int          busy;
+  int          count;
+public:
+  cTransponderQueue(void);
+  void       Push(int Owner, cChannel * Transponder);
+  cChannel * Pop(int Owner);  // oldest from own deque, otherwise newest from another one
+  int        Count(void);
+  void       Clear(void);
+  void       SetBusy(bool On);
+  bool       Idle(int TimeoutMs);  // waits for a transponder or until no device is busy, true if both are gone
+  };
+
+extern cTransponderQueue TransponderQueue;
 
 //--------------------------------------------------------------------------------------------
 
 bool       is_known_initial_transponder(cChannel * newChannel, bool auto_allowed, cChannels * list = NULL);
+bool       is_known_initial_transponder(cChannel * newChannel, bool auto_allowed, cTransponders * list);
 bool       is_nearly_same_frequency(const cChannel * chan_a, const cChannel * chan_b, uint delta = 2001);
 bool       is_different_transponder_deep_scan(const cChannel * a, const cChannel * b, bool auto_allowed);
+bool       is_different_transponder_deep_scan(const sTransponderKey &a, const sTransponderKey &b, bool auto_allowed);
 cChannel * GetByTransponder(const cChannel * Transponder);
 int        ServicesOnTransponder(const cChannel * Transponder);
-int        AddChannels();
+int        AddChannels(const cChannel * Transponder = NULL);
 void       resetLists();
 
+//--------cSectionTracker---------------------------------------------------------------------
+// remembers which sections of each subtable (table_id + table_id_extension)
+// were received, so that a filter may stop as soon as its tables are complete.
+
+class cSectionTracker {
+private:
+  class cSubTable {
+public:
+    int   id;
+    int   version;
+    int   lastSection;
+    bool  wrapped;
+    uchar received[32];  // one bit per section_number 0..255
+    };
+  cSubTable subTables[_MAXSUBTABLES];
+  int       numSubTables;
+public:
+  cSectionTracker(void) { Reset(); };
+  void Reset(void);
+  bool Add(u_char Tid, u_short Id, int Version, int Section, int LastSection); // true if not seen before
+  bool Complete(void);  // all sections of all known subtables received
+  bool Wrapped(void);   // complete and each subtable was repeated at least once
+  bool Empty(void) { return (numSubTables == 0); };
+  };
+
+//--------cTableVersions--------------------------------------------------------------------
+// NIT, PAT, SDT and PMT versions of each transport stream seen by previous scans,
+// one line per transport stream: <source>:<onid>:<tsid>:<nit>:<pat>:<sdt>:<pmt>
+// pmt is a checksum over service ids and versions of all PMTs.
+// A version of -1 is unknown. Guarded by ScanListMutex.
+
+class cTableVersion : public cListObject {
+public:
+  int source;
+  int onid;
+  int tsid;
+  int nit;
+  int pat;
+  int sdt;
+  int pmt;
+  cTableVersion(void);
+  bool Parse(const char * s);
+  bool Save(FILE * f);
+  };
+
+class cTableVersions : public cConfig<cTableVersion> {
+public:
+  cTableVersion * Get(int Source, int Onid, int Tsid);
+  bool HasSource(int Source);
+  void Set(int Source, int Onid, int Tsid, int Nit, int Pat, int Sdt, int Pmt);
+  };
+
+extern cTableVersions TableVersions;
+
+//--------cTransponderCache------------------------------------------------------------------
+// transponders of the last complete scan of a delivery system and country
+// or satellite (all of them which had lock, initial ones and those found in
+// NIT), in vdr's channels.conf syntax. Used to seed a warm start scan.
+
+class cTransponderCache : public cConfig<cChannel> {
+private:
+  static cString FileName(int Type, const char * List);
+public:
+  bool Load(int Type, const char * List);  // false, if there are no cached transponders
+  static bool Save(int Type, const char * List, cTransponders * Transponders);  // only those with lock
+  };
+
+//--------cScanTimer--------------------------------------------------------------------------
+// one thread for the deadlines of all filters of a scan, instead of one
+// thread per filter sleeping in 10msec steps until its timeout.
+// Started once by cScanner::Action() before any device scans, stopped at its end.
+
+class cDeadline {
+  friend class cScanTimer;
+private:
+  uint64_t    deadline;     // cTimeMs::Now() based
+  cDeadline * next;
+  cTimeMs     started;
+protected:
+  virtual void Expired(void) = 0;  // called from cScanTimer's thread, should only set flags
+public:
+  cDeadline(void);
+  virtual ~cDeadline();
+  void SetDeadline(int Ms);
+  void ExtendDeadline(int Ms);            // as SetDeadline(), but Elapsed() keeps counting from the start
+  void ClearDeadline(bool Wait = false);  // Wait: until a running Expired() returned, for destructors
+  int  Elapsed(void) { return (int) started.Elapsed(); };
+  };
+
+class cScanTimer : public cThread {
+private:
+  cMutex      mutex;
+  cCondVar    changed;
+  cDeadline * deadlines;    // not sorted, there are only a few per device
+  cDeadline * expiring;
+  void Remove(cDeadline * Deadline);
+protected:
+  virtual void Action(void);
+public:
+  cScanTimer(void);
+  void Add(cDeadline * Deadline);
+  void Del(cDeadline * Deadline, bool Wait);
+  void Stop(void);
+  };
+
+extern cScanTimer ScanTimer;
+
 //--------cPatScanner-------------------------------------------------------------------------
 class cPmtScanner;
 
-class cPatScanner : public cFilter, public cThread {
+class cPatScanner : public cFilter, public cDeadline {
 private:
   bool          active;
-  cPmtScanner * cPmtScanners[MAX_PMTS];
+  cPmtScanner * pmts;
   cDevice *     parent;
+  cSectionTracker sections;
+  bool PmtsDone(void);
 protected:
   virtual void Process(u_short Pid, u_char Tid, const u_char * Data, int Length);
-  virtual void Action(void);
+  virtual void Expired(void);
 public:
   cPatScanner(cDevice * Parent);
   ~cPatScanner();
   bool Active(void) {
     return (active);
     };
+  void Check(void);  // finish, if PAT and PMTs are complete. Section handler thread only.
+  };
+
+//--------cVersionScanner---------------------------------------------------------------------
+// reads only the ids and versions of PAT, PMTs and SDT actual of a transponder,
+// to decide whether it changed since the last scan.
+
+class cVersionScanner : public cFilter, public cDeadline {
+private:
+  struct sPmtVersion {
+    int sid;
+    int pid;
+    int version;
+    };
+  bool active;
+  int  source;
+  int  onid;
+  int  tsid;
+  int  pat;
+  int  sdt;
+  int  pmt;                         // checksum over all PMTs, -1 if incomplete
+  sPmtVersion pmts[MAX_PMTS];
+  int  numPmts;
+  int  nextPmt;                     // pmts[0..nextPmt-1] are (or were) filtered
+  int  pendingPmts;                 // filtered, but not yet received
+  bool Known(void);
+  void Done(void);
+protected:
+  virtual void Process(u_short Pid, u_char Tid, const u_char * Data, int Length);
+  virtual void Expired(void);
+public:
+  cVersionScanner(void);
+  ~cVersionScanner();
+  bool Active(void) { return (active); };
+  bool Unchanged(void);         // PAT, PMT and SDT versions are the same as in TableVersions
+  bool NitUnchanged(int Nit);   // Nit is the same as the NIT actual version in TableVersions
+  void Store(int Nit);          // remember the versions found, Nit: NIT actual version or -1
   };
 
 //--------cNitScanner-------------------------------------------------------------------------
 
-class cNitScanner : public cFilter, public cThread {
+class cNitScanner : public cFilter, public cDeadline {
 private:
 
   class cNit {
@@ -80,66 +347,96 @@ public:
     char    name[MAXNETWORKNAME];
     bool    hasTransponder;
     };
-  cSectionSyncer syncNit;
+  cSectionTracker sections;
   cNit           nits[_MAXNITS];
   u_short        networkId;
+  int            version;       // of NIT actual, -1 if not yet seen
   int            numNits;
   int            tableId;
+  int            owner;
   bool           active;
+  void Check(void);
 protected:
   virtual void Process(u_short Pid, u_char Tid, const u_char * Data, int Length);
-  virtual void Action(void);
+  virtual void Expired(void);
 public:
-  cNitScanner(int TableId);
+  cNitScanner(int TableId, int Owner = 0);
   ~cNitScanner();
   bool Active(void) {
     return (active);
     };
+  int Version(void) { return (version); };
   };
 
 //--------cPmtScanner-------------------------------------------------------------------------
 
+// one filter for the PMTs of all services of a transponder. At most Budget
+// pids are filtered at once; if more are waiting, pids which didn't deliver
+// within _PMT_TIMESLOT are moved to the end of the queue.
+
 class cPmtScanner : public cFilter {
 private:
-  bool       active;
-  int        pmtPid;
-  int        pmtSid;
-  cChannel * Channel;
-  int        numPmtEntries;
-  bool PmtVersionChanged(int PmtPid, int Sid, int Version);
+  class cService {
+public:
+    cChannel * channel;
+    u_short    sid;
+    u_short    pid;
+    bool       done;
+    };
+  class cPmtPid {
+public:
+    u_short    pid;
+    bool       on;      // currently filtered
+    cTimeMs    since;
+    };
+  cService   services[MAX_PMTS];
+  cPmtPid    pids[MAX_PMTS];   // pids with pending services, in order of filtering
+  int        numServices;
+  int        numPids;
+  int        numOn;
+  int        budget;
+  cPatScanner * pat;
+  bool Pending(u_short Pid);
+  void Remove(int Index);
+  void Fill(void);
+  void Done(cService * Service);
 protected:
   virtual void Process(u_short Pid, u_char Tid, const u_char * Data, int Length);
 public:
-  bool Active(void) {
-    return (active);
-    };
-  cPmtScanner(cChannel * channel, u_short Sid, u_short PmtPid);
+  cPmtScanner(cPatScanner * Pat, int Budget);
+  bool Add(cChannel * Channel, u_short Sid, u_short PmtPid); // false, if MAX_PMTS reached
+  void Rotate(void);   // call periodically, from the section handler thread
+  bool Done(void);     // all services got their PMT
   };
 
 //--------cSdtScanner-------------------------------------------------------------------------
 
-class cSdtScanner : public cFilter, public cThread {
+class cSdtScanner : public cFilter, public cDeadline {
 private:
   bool           active;
   int            tableId;
-  cSectionSyncer sectionSyncer;
+  int            owner;
+  cPatScanner *  pat;
+  bool           patWait;  // deadline not yet armed, PAT running in parallel is still active
+  cSectionTracker sections;
+  bool PatPending(SI::SDT & Sdt);
 protected:
   virtual void Process(u_short Pid, u_char Tid, const u_char * Data, int Length);
-  virtual void Action(void);
+  virtual void Expired(void);
 public:
   bool Active(void) { return (active); };
-  cSdtScanner(int TableId);
+  cSdtScanner(int TableId, int Owner = 0, cPatScanner * Pat = NULL); // Pat: running in parallel, see PatPending()
   ~cSdtScanner();
   };
 
 //--------cEitScanner-------------------------------------------------------------------------
 
-class cEitScanner : public cFilter, public cThread {
+class cEitScanner : public cFilter, public cDeadline {
 private:
   bool          active;
 protected:
   virtual void Process(u_short Pid, u_char Tid, const u_char *Data, int Length);
-  virtual void Action(void);
+  virtual void Expired(void);
 public:
   bool Active(void) { return (active); };
   cEitScanner(void);
@@ -16,7 +16,9 @@
 #include <vdr/tools.h>
 #include <vdr/svdrp.h>
 #include <vdr/device.h>
+#include <vdr/plugin.h>
 #include "scanner.h"
+#include "scanstats.h"
 #include "menusetup.h"
 #include "common.h"
 #include "satellites.h"
@@ -119,6 +121,34 @@ cDevice * GetPreferredDevice(cChannel * Channel) {
   return (NULL);
   }
 
+/* Preferred and all other devices, which are able to scan Channel's
+ * delivery system and are identical to Preferred (same type and
+ * capabilities), so that scan parameters apply to all of them.
+ * Devices in use by vdr (ie. recordings) are left out.
+ */
+static int GetScanDevices(cDevice * Preferred, cChannel * Channel, cDevice ** Devices) {
+  int count = 0;
+  uint type = GetFeType(Preferred->CardIndex());
+  uint caps = GetCapabilities(Preferred->CardIndex());
+
+  Devices[count++] = Preferred;
+  for (int i = 0; i < MAXDEVICES; i++) {
+    cDevice * dev = cDevice::GetDevice(i);
+    if (dev == NULL || dev == Preferred) {
+      continue;
+      }
+    if (!dev->ProvidesChannel(Channel) || dev->Receiving(true)) {
+      continue;
+      }
+    if ((GetFeType(dev->CardIndex()) != type) || (GetCapabilities(dev->CardIndex()) != caps)) {
+      continue;
+      }
+    dlog(1, "device %d = %s: using in parallel", dev->CardIndex(), *GetFeName(dev->CardIndex()));
+    Devices[count++] = dev;
+    }
+  return (count);
+  }
+
 int PvrHasLock(int timeout, int videodev) {
   struct v4l2_tuner tuner;
   cString           devname = cString::sprintf("/dev/video%d", videodev);
@@ -163,14 +193,17 @@ int PvrGetSignal(int videodev) {
   }
 
 
-cScanner::cScanner(const char * Description, scantype_t Type) {
+cScanner::cScanner(const char * Description, scantype_t Type, bool Warm) {
   type       = Type;
+  warm       = Warm;
+  locks      = 0;
   shouldstop = false;
   single     = false;
   aChannel   = NULL;
   dev        = NULL;
   status     = 0;
-  StateMachine = NULL;
+  thisChannel    = 0;
+  numScanDevices = 0;
   initialTransponders = 0;
   Start();
   }
@@ -180,6 +213,155 @@ cScanner::~cScanner(void) {
   Scanner = NULL;
   }
 
+void cScanner::SetShouldstop(bool On) {
+  cMutexLock lock(&mutex);
+  shouldstop = On;
+  if (On)
+     for (int i = 0; i < numScanDevices; i++)
+        scanDevices[i]->DoStop();
+  }
+
+cChannel * cScanner::NextInitialTransponder(void) {
+  cMutexLock lock(&mutex);
+  cChannel * Transponder = initialList.First();
+  if (Transponder)
+     initialList.Del(Transponder, false);
+  return (Transponder);
+  }
+
+void cScanner::SetProgress(const cChannel * Transponder, bool Skipped) {
+  cMutexLock lock(&ScanListMutex);
+  ++thisChannel;
+  if (Skipped)
+     return;
+  lProgress = (int) (thisChannel * 100) / initialTransponders;
+  lTransponder = *PrintTransponder(Transponder);
+  if (MenuScanning) {
+    MenuScanning->SetProgress(lProgress, type, (initialTransponders - thisChannel));
+    MenuScanning->SetTransponder(Transponder);
+    }
+  }
+
+void cScanner::SetLock(void) {
+  cMutexLock lock(&mutex);
+  locks++;
+  }
+
+/* Scans initialList with all suitable devices in parallel,
+ * returns if all of them are done or scan was stopped.
+ */
+void cScanner::RunScanDevices(bool UseNit) {
+  cDevice * Devices[MAXDEVICES];
+  int       count = GetScanDevices(dev, aChannel, Devices);
+
+  dlog(1, "scanning %d transponders using %d device%s",
+       initialList.Count(), count, count > 1 ? "s" : "");
+
+  mutex.Lock();
+  for (numScanDevices = 0; numScanDevices < count; numScanDevices++)
+     scanDevices[numScanDevices] = new cScanDevice(this, Devices[numScanDevices], UseNit);
+  mutex.Unlock();
+
+  for (bool active = true; active;) {
+     cCondWait::SleepMs(100);
+     active = false;
+     for (int i = 0; i < count; i++)
+        if (scanDevices[i]->Active())
+           active = true;
+     }
+
+  mutex.Lock();
+  for (int i = 0; i < numScanDevices; i++)
+     DELETENULL(scanDevices[i]);
+  numScanDevices = 0;
+  mutex.Unlock();
+  }
+
+//--------cScanDevice-------------------------------------------------------------------------
+
+cScanDevice::cScanDevice(cScanner * Parent, cDevice * Dev, bool UseNit) :
+    cThread("wirbelscan device") {
+  parent       = Parent;
+  dev          = Dev;
+  useNit       = UseNit;
+  StateMachine = NULL;
+  TransponderQueue.SetBusy(true);  // until its initial transponders are done
+  Start();
+  }
+
+cScanDevice::~cScanDevice(void) {
+  DoStop();
+  Cancel(3);
+  }
+
+void cScanDevice::DoStop(void) {
+  Lock();
+  if (StateMachine)
+     StateMachine->DoStop();
+  Unlock();
+  }
+
+void cScanDevice::Action(void) {
+  cChannel * Transponder;
+
+  while (Running() && parent->ActionAllowed() && (Transponder = parent->NextInitialTransponder())) {
+    if (is_known_initial_transponder(Transponder, false)) {
+      // got it meanwhile from NIT on another device.
+      dlog(1, "%d: skipped (already known transponder)", Transponder->Frequency());
+      parent->SetProgress(Transponder, true);
+      delete Transponder;
+      continue;
+      }
+    parent->SetProgress(Transponder);
+    dev->SwitchChannel(Transponder, false);
+
+    int  ms;
+    bool lock = WaitForLock(dev, Transponder, 2500, &ms);
+    if (!lock)
+      ScanStats.Tune(false);  // locked ones are counted by the cStateMachine's eTune.
+
+    if (lock)
+      dlog(1, "   device %d: lock after %dms", dev->CardIndex(), ms);
+    else
+      dlog(1, "   device %d: no lock (gave up after %dms)", dev->CardIndex(), ms);
+
+    ScanListMutex.Lock();
+    lStrength = GetFrontendStrength(dev->CardIndex());
+    if (MenuScanning) MenuScanning->SetStr(lStrength, lock);
+    ScanListMutex.Unlock();
+
+    if (lock) {
+       parent->SetLock();
+       RunStateMachine(Transponder);
+       }
+    dev->DetachAllReceivers();
+    delete Transponder;
+    }
+  TransponderQueue.SetBusy(false);
+
+  /* no initial transponders left. As long as other devices are
+   * busy, their NIT may deliver more transponders; help out.
+   */
+  while (useNit && Running() && parent->ActionAllowed() && !TransponderQueue.Idle(1000)) {
+    if (TransponderQueue.Count())
+       RunStateMachine(NULL);
+    }
+  }
+
+void cScanDevice::RunStateMachine(cChannel * Transponder) {
+  TransponderQueue.SetBusy(true);
+  Lock();
+  StateMachine = new cStateMachine(dev, Transponder, useNit);
+  Unlock();
+  while (StateMachine->Active())
+     cCondWait::SleepMs(100);
+  Lock();
+  DELETENULL(StateMachine);
+  Unlock();
+  dev->DetachAllReceivers();
+  TransponderQueue.SetBusy(false);
+  }
+
 void cScanner::Action(void) {
   bool          crAuto, modAuto, invAuto, bwAuto, hAuto, tmAuto, gAuto, roAuto, s2Support, vsbSupport, qamSupport, vbiSupport = false;
   bool          useNit = true;
@@ -191,7 +373,6 @@ void cScanner::Action(void) {
   int           this_channellist = DVBT_DE, this_bandwidth = 8000000, this_qam = QAM_AUTO, atsc = ATSC_VSB, dvb;
   uint16_t      frontend_type = FE_QPSK;
   int           qam_no_auto      = 0, this_atsc = 0;
-  int           thisChannel      = 0; 
 
   const char *  country   = country_to_short_name(wSetup.CountryIndex);
   const char *  satellite = satellite_to_short_name(wSetup.SatIndex);
@@ -208,7 +389,13 @@ void cScanner::Action(void) {
 
   resetLists();
   initialTransponders = 0;
+  thisChannel = 0;
   status = 1;
+  ScanStats.Start(type, (type == DVB_SAT) ? satellite : country);
+  if (wSetup.incremental) {
+    cMutexLock lock(&ScanListMutex);
+    TableVersions.Load(AddDirectory(cPlugin::ConfigDirectory("wirbelscan"), "versions.conf"));
+    }
   dlog(1, "Running on VDR %s (%s)", VDRVERSION,
      #ifdef PLUGINPARAMPATCHVERSNUM
        "with IPTV patch. :-)");
@@ -654,6 +841,27 @@ void cScanner::Action(void) {
     } // end switch type
 
   if (MenuScanning) MenuScanning->SetStatus(1);
+  ScanTimer.Start();  // deadlines of all filters, until stop
+
+  /* warm start: the transponders of the last scan first. Only if none of
+   * them locks, fall back to the full sweep below.
+   */
+  if (warm && (type == DVB_TERR || type == DVB_CABLE || type == DVB_SAT || type == DVB_ATSC)) {
+     cTransponderCache cache;
+     if (cache.Load(type, (type == DVB_SAT) ? satellite : country)) {
+        dlog(1, "warm start: %d cached transponders", cache.Count());
+        for (cChannel * t = cache.First(); t; t = cache.Next(t))
+           initialList.Add(new cChannel(* t));
+        initialTransponders = cache.Count();
+        RunScanDevices(useNit);
+        if (locks)
+           goto stop;
+        dlog(1, "warm start: no lock on cached transponders, sweeping.");
+        initialTransponders = thisChannel = 0;
+        }
+     else
+        dlog(1, "warm start: no cached transponders, sweeping.");
+     }
 
   //count channels.
 
@@ -776,7 +984,7 @@ void cScanner::Action(void) {
                 */
                if (sat_list[this_channellist].items[channel].modulation_system == SYS_DVBS2) {
                  if (!(caps_s2) || (DVB_API_VERSION < 5) || (wSetup.enable_s2 == 0)) {
-                   dlog(1, "%d: skipped ()",
+                   dlog(1, "%d: skipped (%s)",
                         sat_list[this_channellist].items[channel].intermediate_frequency,
                         (wSetup.enable_s2 == 0)?"disabled":"no driver support");
                    thisChannel++;
@@ -870,55 +1078,35 @@ void cScanner::Action(void) {
                break;
              default:;
              } // end switch type
-          ++thisChannel;
-          lProgress = (int) (thisChannel * 100) / initialTransponders;
-          lTransponder = *PrintTransponder(aChannel);
-          if (MenuScanning) {
-            MenuScanning->SetProgress(lProgress, type, (initialTransponders - thisChannel));
-            MenuScanning->SetTransponder(aChannel);
-            }
+
+          if (type != PVRINPUT && type != PVRINPUT_FM) {
+             // dvb: tuned later by cScanDevice(s), see RunScanDevices().
+             initialList.Add(new cChannel(* aChannel));
+             continue;
+             }
+
+          SetProgress(aChannel);
           dev->SwitchChannel(aChannel, false);
-          SwReceiver = new cSwReceiver(aChannel);
-          dev->AttachReceiver(SwReceiver);
+          if (type == PVRINPUT) {
+             // no teletext on fm radio. Otherwise reused, as long as Tpid doesn't change.
+             if (SwReceiver && (SwReceiver->Tpid() != aChannel->Tpid()))
+                DELETENULL(SwReceiver);
+             if (! SwReceiver)
+                SwReceiver = new cSwReceiver(aChannel);
+             dev->AttachReceiver(SwReceiver);
+             }
 
           switch (type) {
-             case DVB_ATSC:
-             case DVB_CABLE:
-             case DVB_SAT:
-             case DVB_TERR:
-             case TRANSPONDER:
-               {
-               bool lock;
-
-               cCondWait::SleepMs(1000);
-               if (GetFrontendStatus(dev->CardIndex()) & FE_HAS_SIGNAL) 
-                 lock = dev->HasLock(1500);
-               else
-                 lock = false;
-
-               lStrength = GetFrontendStrength(dev->CardIndex());
-               if (MenuScanning) MenuScanning->SetStr(lStrength, lock);
-               if (lock) {
-                  StateMachine = new cStateMachine(dev, aChannel, useNit);
-                  while (StateMachine && StateMachine->Active())
-                     cCondWait::SleepMs(100);
-                  //StateMachine = NULL;
-                  DELETENULL(StateMachine);
-                  }
-               }
-               break;
              case PVRINPUT:
                { //tv scan
-               int iterations = 0;
                cCondWait::SleepMs(500);
                lStrength = PvrHasLock(1500, videodev);
 
                if (MenuScanning) MenuScanning->SetStr(lStrength, lStrength > 0);
                if (lStrength) {
                  cCondWait::SleepMs(1000);
-                 SwReceiver->Reset(); // try to cleanup old vbi cached data from pvrinput and start thread
-                 while (! SwReceiver->Finished() && ++iterations < 400)
-                    cCondWait::SleepMs(100);
+                 SwReceiver->Reset(); // ignore old vbi data cached by pvrinput
+                 SwReceiver->Wait();
                  cChannel *     newChannel = new cChannel;                
                  newChannel->Parse(*aChannel->ToText());
                  newChannel->SetName(*channelname, "", "");
@@ -953,7 +1141,6 @@ void cScanner::Action(void) {
                     MenuScanning->SetChan(1);
                  }
                dev->Detach(SwReceiver);
-               delete(SwReceiver);
                break;
                }
              case PVRINPUT_FM:
@@ -1069,6 +1256,9 @@ void cScanner::Action(void) {
       } // end loop channel
     } // end loop mod_parm
 
+  if (type != PVRINPUT && type != PVRINPUT_FM)
+     RunScanDevices(useNit);
+
   if (type == PVRINPUT) {
       int d;
       cDevice * aDevice;
@@ -1119,8 +1309,22 @@ void cScanner::Action(void) {
       } // end type pvrinput
 
 stop:
+  initialList.Clear();
+  ScanTimer.Stop();
+  ScanListMutex.Lock();
+  ScanStats.Stop(ScannedTransponders.Count());
+  CloseFrontends();
+  if (wSetup.incremental && TableVersions.FileName())
+    TableVersions.Save();
+  if (ActionAllowed() && locks && NewTransponders.Count() &&
+     (type == DVB_TERR || type == DVB_CABLE || type == DVB_SAT || type == DVB_ATSC)) {
+    // complete scan: cache its transponders for the next warm start.
+    cTransponderCache::Save(type, (type == DVB_SAT) ? satellite : country, &ScannedTransponders);
+    }
+  ScanListMutex.Unlock();
   if (MenuScanning) MenuScanning->SetStatus((status = 0));
   if (dev) dev->DetachAllReceivers();
+  DELETENULL(SwReceiver);
   Channels.ReNumber();
   SetShouldstop(true);
   dlog(3, "leaving scanner");
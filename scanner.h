@@ -22,6 +22,26 @@
 #include "statemachine.h"
 #include "common.h"
 
+class cScanner;
+
+/* one per dvb device, takes initial transponders from cScanner
+ * and runs a cStateMachine on each one giving lock.
+ */
+class cScanDevice : public cThread {
+private:
+  cScanner      * parent;
+  cDevice       * dev;
+  bool            useNit;
+  cStateMachine * StateMachine;
+  void RunStateMachine(cChannel * Transponder);
+protected:
+  virtual void Action(void);
+public:
+  cScanDevice(cScanner * Parent, cDevice * Dev, bool UseNit);
+  virtual ~cScanDevice(void);
+  void DoStop(void);
+  };
+
 class cScanner : public cThread {
 private:
   bool       shouldstop;
@@ -29,23 +49,33 @@ private:
   uint32_t   user[3];
   int        status;
   int        initialTransponders;
+  int        thisChannel;
   scantype_t type;
   cDevice  * dev;
   cChannel * aChannel;
   #if VDRVERSNUM >= 10713
   cDvbTransponderParameters * params;
   #endif
-  cStateMachine * StateMachine;
+  cMutex          mutex;
+  cList<cChannel> initialList;              // initial transponders, not yet tuned
+  cScanDevice   * scanDevices[MAXDEVICES];
+  int             numScanDevices;
+  bool            warm;                     // seed from cTransponderCache first
+  int             locks;                    // initial transponders with lock
+  void RunScanDevices(bool UseNit);
 protected:
   virtual void Action(void);
 public:
-  cScanner(const char * Description, scantype_t Type);
+  cScanner(const char * Description, scantype_t Type, bool Warm = false);
   virtual      ~cScanner(void);
-  virtual void SetShouldstop(bool On) { shouldstop = On; if (StateMachine) StateMachine->DoStop();};
+  virtual void SetShouldstop(bool On);
   virtual bool ActionAllowed(void)    { return (Running() && !shouldstop); };
           int  Status()               { return status; };
           int  DvbType()              { return type; };
           int  InitialTransponders()  { return initialTransponders; };
+  cChannel *   NextInitialTransponder(void);
+  void         SetProgress(const cChannel * Transponder, bool Skipped = false);
+  void         SetLock(void);
   };
 
 #endif
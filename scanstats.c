@@ -0,0 +1,174 @@
+/*
+ * scanstats.c: wirbelscan - A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ * $Id$
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "scanstats.h"
+#include "statemachine.h"
+#include "menusetup.h"
+#include "common.h"
+
+cScanStats ScanStats;
+
+//--------cScanStats--------------------------------------------------------------------------
+
+cScanStats::cScanStats(void) {
+  running  = false;
+  start    = 0;
+  type     = NO_DEVICE;
+  tunes    = 0;
+  locks    = 0;
+  sections = 0;
+  channels = 0;
+  memset(stateCount, 0, sizeof(stateCount));
+  memset(stateMs,    0, sizeof(stateMs));
+  memset(&histograms, 0, sizeof(histograms));
+  }
+
+void cScanStats::Start(int Type, const char * List) {
+  cMutexLock lock(&mutex);
+  running  = true;
+  start    = time(NULL);
+  wall.Set();
+  type     = Type;
+  list     = List;
+  tunes    = 0;
+  locks    = 0;
+  sections = 0;
+  channels = 0;
+  memset(stateCount, 0, sizeof(stateCount));
+  memset(stateMs,    0, sizeof(stateMs));
+  }
+
+void cScanStats::Tune(bool Lock) {
+  cMutexLock lock(&mutex);
+  tunes++;
+  if (Lock)
+    locks++;
+  }
+
+void cScanStats::Section(void) {
+  cMutexLock lock(&mutex);
+  sections++;
+  }
+
+void cScanStats::Channels(int Count) {
+  cMutexLock lock(&mutex);
+  channels += Count;
+  }
+
+// histogram of a cStateMachine::eState, -1 if none.
+static int HistogramIndex(int State) {
+  using namespace WIRBELSCAN_SERVICE;
+  switch (State) {
+     case cStateMachine::eTune:        return StatsTune;
+     case cStateMachine::eScanNit:     return StatsScanNit;
+     case cStateMachine::eScanPat:     return StatsScanPat;
+     case cStateMachine::eScanSdt:     return StatsScanSdt;
+     case cStateMachine::eScanEit:     return StatsScanEit;
+     case cStateMachine::eAddChannels: return StatsAddChannels;
+     case cStateMachine::eScanTables:  return StatsScanTables;
+     default:                          return -1;
+     }
+  }
+
+void cScanStats::State(int System, int State, int Ms) {
+  using namespace WIRBELSCAN_SERVICE;
+  int index = HistogramIndex(State);
+  cMutexLock lock(&mutex);
+
+  if ((State < 0) || (State >= _MAXSTATES))
+    return;
+  stateCount[State]++;
+  stateMs[State] += Ms;
+
+  if ((System < 0) || (System >= STATS_SYSTEMS) || (index < 0))
+    return;
+  cWirbelscanHistogram * h = &histograms.histogram[System][index];
+  int bucket = 0;
+  while ((bucket < STATS_BUCKETS - 1) && (Ms >> (bucket + 1)))
+    bucket++;
+  h->count++;
+  h->sum_ms += Ms;
+  h->max_ms = max(h->max_ms, (uint32_t) Ms);
+  h->buckets[bucket]++;
+  }
+
+void cScanStats::GetHistograms(WIRBELSCAN_SERVICE::cWirbelscanStats * Stats) {
+  cMutexLock lock(&mutex);
+  *Stats = histograms;
+  }
+
+void cScanStats::ClearHistograms(void) {
+  cMutexLock lock(&mutex);
+  memset(&histograms, 0, sizeof(histograms));
+  }
+
+// one line per delivery system and state:
+// <system> <state> <count> <sum ms> <max ms> <buckets 0..STATS_BUCKETS-1>
+cString cScanStats::HistogramsToString(void) {
+  using namespace WIRBELSCAN_SERVICE;
+  static const char * systems[] = { "DVB-T", "DVB-C", "DVB-S", "PVRINPUT", "PVRINPUT_FM", "ATSC" };
+  static const char * states[]  = { "Tune", "ScanNit", "ScanPat", "ScanSdt", "ScanEit", "AddChannels", "ScanTables" };
+  cWirbelscanStats stats;
+  cString s = "";
+
+  GetHistograms(&stats);
+  for (int i = 0; i < STATS_SYSTEMS; i++) {
+    for (int j = 0; j < StatsStates; j++) {
+      cWirbelscanHistogram * h = &stats.histogram[i][j];
+      if (!h->count)
+        continue;
+      s = cString::sprintf("%s%s%s %s %u %u %u", *s, **s ? "\n" : "", systems[i], states[j],
+                           h->count, h->sum_ms, h->max_ms);
+      for (int b = 0; b < STATS_BUCKETS; b++)
+        s = cString::sprintf("%s %u", *s, h->buckets[b]);
+      }
+    }
+  return s;
+  }
+
+void cScanStats::Stop(int Transponders) {
+  static const char * types[] = { "DVB-T", "DVB-C", "DVB-S", "PVRINPUT", "PVRINPUT_FM", "ATSC" };
+  cMutexLock lock(&mutex);
+
+  if (!running)
+    return;
+  running = false;
+
+  const char * t = ((type >= DVB_TERR) && (type <= DVB_ATSC)) ? types[type] : "TRANSPONDER";
+  int ms = (int) wall.Elapsed();
+
+  dlog(1, "scan statistics: %s %s, %d.%03ds, %d tunes, %d locks, %llu sections, %d transponders, %d channels",
+       t, *list, ms / 1000, ms % 1000, tunes, locks, (unsigned long long) sections, Transponders, channels);
+  for (int i = 0; i < _MAXSTATES; i++)
+    if (stateCount[i])
+      dlog(3, "   %-16s %6d x %8llums", cStateMachine::StateName(i), stateCount[i], (unsigned long long) stateMs[i]);
+
+  if (!*fileName)
+    return;
+  FILE * f = fopen(*fileName, "a");
+  if (!f) {
+    dlog(0, "could not open %s", *fileName);
+    return;
+    }
+  fprintf(f, "{\"version\":\"%s\",\"start\":%ld,\"type\":\"%s\",\"list\":\"%s\","
+             "\"wall_ms\":%d,\"tunes\":%d,\"locks\":%d,\"sections\":%llu,"
+             "\"transponders\":%d,\"channels\":%d,\"states\":{",
+          extVer, (long) start, t, *list, ms, tunes, locks, (unsigned long long) sections,
+          Transponders, channels);
+  for (int i = 0, n = 0; i < _MAXSTATES; i++) {
+    if (!stateCount[i])
+      continue;
+    fprintf(f, "%s\"%s\":{\"count\":%d,\"ms\":%llu}", n++ ? "," : "",
+            cStateMachine::StateName(i), stateCount[i], (unsigned long long) stateMs[i]);
+    }
+  fprintf(f, "}}\n");
+  fclose(f);
+  }
@@ -0,0 +1,64 @@
+/*
+ * scanstats.h: wirbelscan - A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ * $Id$
+ */
+
+#ifndef __WIRBELSCAN_SCANSTATS_H_
+#define __WIRBELSCAN_SCANSTATS_H_
+
+#include <stdint.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+#include "wirbelscan_services.h"
+
+#define _MAXSTATES                            16  //>= number of cStateMachine::eState
+
+/* Counters and timing of one scan, from cScanner::Action start to stop,
+ * to measure performance changes of scanner and filters. If a file is
+ * given (--benchmark=FILE), each finished scan appends one line of JSON:
+ *
+ *  {"version":"0.0.7","start":1286652000,"type":"DVB-T","list":"DE",
+ *   "wall_ms":81234,"tunes":57,"locks":6,"sections":4711,
+ *   "transponders":6,"channels":31,
+ *   "states":{"Tune":{"count":57,"ms":9120}, ...}}
+ *
+ * Independent of single scans, the durations of the main states are kept
+ * as histograms per delivery system since vdr start, see wirbelscan_GetStats.
+ */
+
+class cScanStats {
+private:
+  cMutex   mutex;
+  bool     running;
+  time_t   start;
+  cTimeMs  wall;
+  int      type;
+  cString  list;
+  int      tunes;
+  int      locks;
+  uint64_t sections;
+  int      channels;
+  int      stateCount[_MAXSTATES];
+  uint64_t stateMs[_MAXSTATES];
+  cString  fileName;
+  WIRBELSCAN_SERVICE::cWirbelscanStats histograms;
+public:
+  cScanStats(void);
+  void SetFile(const char * FileName) { fileName = FileName; };
+  void Start(int Type, const char * List);
+  void Stop(int Transponders);
+  void Tune(bool Lock);
+  void Section(void);
+  void Channels(int Count);
+  void State(int System, int State, int Ms);      // System: scantype_t
+  void GetHistograms(WIRBELSCAN_SERVICE::cWirbelscanStats * Stats);
+  void ClearHistograms(void);
+  cString HistogramsToString(void);
+  };
+
+extern cScanStats ScanStats;
+
+#endif
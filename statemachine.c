@@ -17,31 +17,27 @@
 #include "dvb_wrapper.h"
 #include "menusetup.h"
 #include "si_ext.h"
+#include "scanstats.h"
 
 using namespace SI_EXT;
 
 ///!-----------------------------------------------------------------
 ///!  v 0.0.5, a dummy receiver. Might be used real later.
+///!  Keeps the device tuned; no thread of its own, any periodic
+///!  checks should use a cDeadline (see scanfilter.h).
 ///!-----------------------------------------------------------------
 
-class cScanReceiver : public cReceiver, public cThread {
+class cScanReceiver : public cReceiver {
 private:
 protected:
-  virtual void Activate(bool On) {
-    if (On) {Start();  }
-    else    {Cancel(0);}
-    };
   virtual void Receive(uchar * Data, int Length) {};
-  virtual void Action(void) {
-    while (Running()) cCondWait::SleepMs(5);
-    }; /*TODO: check here periodically for lock and wether we got any data!*/
 public:
   cScanReceiver(const cChannel* chan, int AnyPid);
   virtual ~cScanReceiver() {cReceiver::Detach(); };
   };
 
 cScanReceiver::cScanReceiver(const cChannel* chan, int AnyPid) :
-     cReceiver(chan, 99), cThread("dummy receiver") { }
+     cReceiver(chan, 99) { }
 
 ///!-----------------------------------------------------------------
 ///!  v 0.0.5, store state in lastState if different and print state
@@ -60,6 +56,8 @@ void cStateMachine::Report(eState State) {
     "------- state: ScanEit -------",
     "------- state: ERROR IN STATEMACHINE, UNKNOWN STATE. -------",
     "------- state: AddChannels -------",
+    "------- state: ScanTables -------",
+    "------- state: CheckVersions -------",
     "------- NULL -------"
     };
 
@@ -68,6 +66,17 @@ void cStateMachine::Report(eState State) {
     }
   };
 
+const char * cStateMachine::StateName(int State) {
+  static const char * names[] = {
+    "Start", "Stop", "Tune", "NextTransponder", "DetachReceiver", "ScanPat",
+    "ScanNit", "ScanSdt", "ScanEit", "Unknown", "AddChannels", "ScanTables",
+    "CheckVersions" };
+
+  if ((State < 0) || (State >= (int) (sizeof(names) / sizeof(names[0]))))
+    return "Unknown";
+  return names[State];
+  }
+
 ///!-----------------------------------------------------------------
 ///!  v 0.0.5, StateMachine constructor
 ///!-----------------------------------------------------------------
@@ -98,28 +107,47 @@ cStateMachine::~cStateMachine(void) {
 void cStateMachine::Action(void) {
   cChannel      * Transponder        = NULL;
   cChannel      * ScannedTransponder = NULL;
-  cChannel      * NewTransponder     = NULL;
   cScanReceiver * aReceiver          = NULL;
   cPatScanner   * PatScanner         = NULL;
   cNitScanner   * NitScanner         = NULL;
   cNitScanner   * NitOtherScanner    = NULL;
   cSdtScanner   * SdtScanner         = NULL;
   cEitScanner   * EitScanner         = NULL;
+  cVersionScanner * VersionScanner   = NULL;
   eState          newState           = state;
   int             count = 0;
+  int             lockTime = 0;
+  sSignalStats    signal;
   bool            s2 = false;
+  cTimeMs         inState;
+  int             system;
+  int             nitVersion = -1;
+  bool            unchanged  = false;  // same PAT and SDT versions as last scan, keep vdr's channels
 
   s2 = GetCapabilities(dev->CardIndex()) & 0x10000000;
+  switch (GetFeType(dev->CardIndex())) {
+     case FE_OFDM: system = DVB_TERR;  break;
+     case FE_QAM:  system = DVB_CABLE; break;
+     case FE_QPSK: system = DVB_SAT;   break;
+     default:      system = DVB_ATSC;
+     }
 
   while (Running() && !stop) {
     cWait.Wait(10);
     Report(state);
     switch (state) {
        case eStart:
+         if (initial == NULL) {
+           // no initial transponder: work off queued ones.
+           newState = eNextTransponder;
+           break;
+           }
          Transponder = initial;
          newState    = eTune;
          ScannedTransponder = new cChannel(* Transponder);
+         ScanListMutex.Lock();
          NewTransponders.Add(ScannedTransponder);
+         ScanListMutex.Unlock();
          break;
 
        case eStop:
@@ -128,10 +156,16 @@ void cStateMachine::Action(void) {
          break;
 
        case eTune:
+         ScanListMutex.Lock();
+         // another device may have scanned it meanwhile.
          if (is_known_initial_transponder(Transponder, false, &ScannedTransponders)) {
+            ScanListMutex.Unlock();
             newState = eNextTransponder;
             break;
             }
+         ScannedTransponder = new cChannel(* Transponder);
+         ScannedTransponders.Add(ScannedTransponder);
+
          lTransponder = PrintTransponder(Transponder);
          dlog(0, "   tuning to %s", *lTransponder);
          
@@ -139,40 +173,52 @@ void cStateMachine::Action(void) {
            MenuScanning->SetTransponder(Transponder);
            MenuScanning->SetProgress(-1, DVB_TERR, -1);
            }
-
-         ScannedTransponder = new cChannel(* Transponder);
-         ScannedTransponders.Add(ScannedTransponder);
+         ScanListMutex.Unlock();
 
          dev->SwitchChannel(Transponder, false);
          aReceiver = new cScanReceiver(Transponder, 99);
          dev->AttachReceiver(aReceiver);
 
-         cCondWait::SleepMs(1000);
-         if (dev->HasLock(3000)) {
-           newState = eScanNit;
-           dlog(0, "   has lock.");
+         if (WaitForLock(dev, Transponder, 4000, &lockTime)) {
+           bool known = false;
+           ScanStats.Tune(true);
+           if (wSetup.incremental && (system != DVB_ATSC)) {  // ATSC has no SDT
+             ScanListMutex.Lock();
+             known = TableVersions.HasSource(Transponder->Source());
+             ScanListMutex.Unlock();
+             }
+           if (known)  // otherwise there's nothing to compare with.
+             newState = eCheckVersions;
+           else
+             newState = wSetup.parallel_tables ? eScanTables : eScanNit;
+           dlog(0, "   has lock after %dms.", lockTime);
            }
          else {
+           dlog(1, "   no lock (gave up after %dms).", lockTime);
+           ScanStats.Tune(false);
            DELETENULL(aReceiver);
            newState = eNextTransponder;
            }
-         lStrength = GetFrontendStrength(dev->CardIndex());
+         if (GetSignalStats(dev->CardIndex(), &signal)) {
+           ScannedTransponders.SetSignal(ScannedTransponder, signal);
+           dlog(3, "   status 0x%.2x, strength %d%s%s%s", signal.status, signal.strength,
+                signal.hasLevel ? *cString::sprintf(", level %.1fdBm", signal.level / 1000.0) : "",
+                signal.hasCnr   ? *cString::sprintf(", cnr %.1fdB", signal.cnr / 1000.0) : "",
+                signal.bitCount ? *cString::sprintf(", ber %.2e", (double) signal.bitErrors / signal.bitCount) : "");
+           }
+         lStrength = max(signal.strength, 0);
          if (MenuScanning)
            MenuScanning->SetStr(lStrength, dev->HasLock(1));
          break;
 
        case eNextTransponder:
+         ScanListMutex.Lock();
          nextTransponders = NewTransponders.Count() - ScannedTransponders.Count();
+         ScanListMutex.Unlock();
          if (! useNit)
              goto DIRECT_EXIT;
 
-         if (NewTransponder == NULL) {
-           NewTransponder = NewTransponders.First();
-           }
-
-         NewTransponder = NewTransponders.Next(NewTransponder);
-
-         if (NULL == (Transponder = NewTransponder)) {
+         if (NULL == (Transponder = TransponderQueue.Pop(dev->CardIndex()))) {
            newState = eStop;
            }
          else {
@@ -185,6 +231,12 @@ void cStateMachine::Action(void) {
            dev->DetachAllReceivers();
            }
          DELETENULL(aReceiver);
+         if (VersionScanner && unchanged) {
+           VersionScanner->Store(nitVersion);
+           }
+         DELETENULL(VersionScanner);
+         unchanged  = false;
+         nitVersion = -1;
          if (stop) {
            newState = eStop;
            }
@@ -195,20 +247,25 @@ void cStateMachine::Action(void) {
 
        case eScanNit:
          if (NULL == NitScanner) {
-           NitScanner = new cNitScanner(TABLE_ID_NIT_ACTUAL);
+           NitScanner = new cNitScanner(TABLE_ID_NIT_ACTUAL, dev->CardIndex());
            dev->AttachFilter(NitScanner);
            }
          if (NULL == NitOtherScanner) {
-           NitOtherScanner = new cNitScanner(TABLE_ID_NIT_OTHER);
+           NitOtherScanner = new cNitScanner(TABLE_ID_NIT_OTHER, dev->CardIndex());
            dev->AttachFilter(NitOtherScanner);
            }
          if ((NitScanner != NULL) && (NitScanner != NULL)) {
            if (!NitScanner->Active() && !NitOtherScanner->Active()) {
+             nitVersion = NitScanner->Version();
+             if (unchanged && !VersionScanner->NitUnchanged(nitVersion)) {
+               dlog(1, "   NIT version changed, rescanning");
+               unchanged = false;
+               }
              dev->Detach(NitScanner);
              DELETENULL(NitScanner);
              dev->Detach(NitOtherScanner);
              DELETENULL(NitOtherScanner);
-             if (stop) {
+             if (stop || unchanged) {
                newState = eDetachReceiver;
                }
              else {
@@ -243,7 +300,7 @@ void cStateMachine::Action(void) {
 
        case eScanSdt:
          if (NULL == SdtScanner) {
-           SdtScanner = new cSdtScanner(TABLE_ID_SDT_ACTUAL);
+           SdtScanner = new cSdtScanner(TABLE_ID_SDT_ACTUAL, dev->CardIndex());
            dev->AttachFilter(SdtScanner);
            }
          else if (!SdtScanner->Active()) {
@@ -259,10 +316,47 @@ void cStateMachine::Action(void) {
            }
          break;
 
+       case eScanTables:
+         // all tables at once, each of them on its own pid. SDT waits for
+         // PAT to add the services first, see cSdtScanner::PatPending().
+         if (NULL == PatScanner) {
+           NitScanner      = new cNitScanner(TABLE_ID_NIT_ACTUAL, dev->CardIndex());
+           NitOtherScanner = new cNitScanner(TABLE_ID_NIT_OTHER, dev->CardIndex());
+           PatScanner      = new cPatScanner(dev);
+           SdtScanner      = new cSdtScanner(TABLE_ID_SDT_ACTUAL, dev->CardIndex(), PatScanner);
+           dev->AttachFilter(NitScanner);
+           dev->AttachFilter(NitOtherScanner);
+           dev->AttachFilter(PatScanner);
+           dev->AttachFilter(SdtScanner);
+           }
+         else if (!NitScanner->Active() && !NitOtherScanner->Active() &&
+                  !PatScanner->Active() && !SdtScanner->Active()) {
+           dev->Detach(SdtScanner);
+           DELETENULL(SdtScanner);
+           dev->Detach(PatScanner);
+           DELETENULL(PatScanner);
+           nitVersion = NitScanner->Version();
+           dev->Detach(NitScanner);
+           DELETENULL(NitScanner);
+           dev->Detach(NitOtherScanner);
+           DELETENULL(NitOtherScanner);
+           if (stop) {
+             newState = eDetachReceiver;
+             }
+           else {
+             newState = eAddChannels;
+             }
+           }
+         break;
+
        case eAddChannels:
-         if ((count = AddChannels())) {
+         if ((count = AddChannels(Transponder))) {
            dlog(1, "added %d channels", count);
            }
+         if (VersionScanner) {
+           VersionScanner->Store(nitVersion);
+           }
+         ScanStats.Channels(count);
          if (MenuScanning)
            MenuScanning->SetChan(count);
          EitScanner = NULL; 
@@ -270,16 +364,37 @@ void cStateMachine::Action(void) {
          break;
 
        case eScanEit:
-         if (NULL == EitScanner) {{
+         if (NULL == EitScanner) {
            EitScanner = new cEitScanner();
            dev->AttachFilter(EitScanner);
            }
-         cCondWait::SleepMs(10000);
-         dev->Detach(EitScanner);
-         DELETENULL(EitScanner);
-         }
+         else if (!EitScanner->Active() || stop) {
+           dev->Detach(EitScanner);
+           DELETENULL(EitScanner);
+           newState = eDetachReceiver;
+           }
+         break;
 
-         newState = eDetachReceiver;
+       case eCheckVersions:
+         if (NULL == VersionScanner) {
+           VersionScanner = new cVersionScanner();
+           dev->AttachFilter(VersionScanner);
+           }
+         else if (!VersionScanner->Active()) {
+           dev->Detach(VersionScanner);
+           if (VersionScanner->Unchanged() && (count = ServicesOnTransponder(Transponder))) {
+             // only NIT, for the transponders to follow.
+             dlog(1, "   unchanged since last scan, keeping %d channels", count);
+             unchanged = true;
+             newState  = eScanNit;
+             }
+           else if (stop) {
+             newState = eDetachReceiver;
+             }
+           else {
+             newState = wSetup.parallel_tables ? eScanTables : eScanNit;
+             }
+           }
          break;
 
        case eUnknown:
@@ -287,8 +402,22 @@ void cStateMachine::Action(void) {
          break;
        default: newState = eUnknown; //every unhandled state should come here.
       }
+    if (newState != state) {
+      dlog(5, "   %s: %dms", StateName(state), (int) inState.Elapsed());
+      ScanStats.State(system, state, inState.Elapsed());
+      inState.Set();
+      }
     state = newState;
     }
 DIRECT_EXIT:
+  ScanStats.State(system, state, inState.Elapsed());
+  if (EitScanner) {
+    dev->Detach(EitScanner);
+    DELETENULL(EitScanner);
+    }
+  if (VersionScanner) {
+    dev->Detach(VersionScanner);
+    DELETENULL(VersionScanner);
+    }
   Cancel();
   }
@@ -18,7 +18,7 @@
  */
 
 class cStateMachine : public cThread {
-private:
+public:
   enum eState {
     eStart = 0,             // init, add next_from_list to NewTransponders      (NextTransponder)
     eStop,                  // cleanup and leave loop                           ()
@@ -31,7 +31,12 @@ private:
     eScanEit,               // eit scan                                         (DetachReceiver)
     eUnknown,               // oops                                             (Stop)
     eAddChannels,           // adding results
+    eScanTables,            // nit, pat/pmt and sdt scan at the same time       (AddChannels)
+    eCheckVersions,         // compare PAT and SDT versions to last scan        (ScanNit, ScanTables)
     };
+  static const char * StateName(int State);
+
+private:
 
   eState     state, lastState;
   cChannel * initial;
@@ -44,7 +49,7 @@ protected:
   virtual void Action(void);
   virtual void Report(eState State);
 public:
-  cStateMachine(cDevice * Dev, cChannel * InitialTransponder, bool UseNit);
+  cStateMachine(cDevice * Dev, cChannel * InitialTransponder, bool UseNit); // InitialTransponder NULL: queued ones only
   virtual ~cStateMachine(void);
   void DoStop() {
     stop = true;
@@ -19,6 +19,9 @@
 #define MAXHITS 50
 #define MINHITS 2
 #define TIMEOUT 15
+#define SETTLED_REPEATS 3                                  /* same network from one source  */
+#define NOCNI_PACKETS 1000                                 /* TS packets without any cni    */
+#define NODATA_MS 3000                                     /* no teletext/vps at all        */
 #define Dec(x)        (CharToInt(x) < 10)                  /* "z" == 0x30..0x39             */
 #define Hex(x)        (CharToInt(x) < 16)                  /* "h" == 0x30..0x39; 0x41..0x46 */
 #define Delim(x)      ((x==46) || (x==58))                 /* date/time delimiter.          */
@@ -26,11 +29,71 @@
 #define Concealed(x)  ((x==0x1b) || (x==0x18))             /* "%" == 0x18; 300231 has typo. */
 
 
-uchar Revert8(uchar inp) {
-  uint8_t lookup[] = {
-      0, 8, 4, 12, 2, 10, 6, 14,
-      1, 9, 5, 13, 3, 11, 7, 15 };
-  return lookup[(inp & 0xF0) >> 4] | lookup[inp & 0xF] << 4;
+/* All of the following run for each byte of each VBI data unit,
+ * therefore lookup tables instead of bit loops.
+ */
+
+static const uchar revert8[256] = {
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+    0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+    0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+    0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+    0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+    0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+    0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+    0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+    0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+    0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+    0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
+  };
+
+/* Hamming 8/4 (ETS 300 706, 8.2), -1: two or more bit errors. */
+static const signed char dehamming_8_4[256] = {
+     1, -1,  1,  1, -1,  0,  1, -1, -1,  2,  1, -1, 10, -1, -1,  7,
+    -1,  0,  1, -1,  0,  0, -1,  0,  6, -1, -1, 11, -1,  0,  3, -1,
+    -1, 12,  1, -1,  4, -1, -1,  7,  6, -1, -1,  7, -1,  7,  7,  7,
+     6, -1, -1,  5, -1,  0, 13, -1,  6,  6,  6, -1,  6, -1, -1,  7,
+    -1,  2,  1, -1,  4, -1, -1,  9,  2,  2, -1,  2, -1,  2,  3, -1,
+     8, -1, -1,  5, -1,  0,  3, -1, -1,  2,  3, -1,  3, -1,  3,  3,
+     4, -1, -1,  5,  4,  4,  4, -1, -1,  2, 15, -1,  4, -1, -1,  7,
+    -1,  5,  5,  5,  4, -1, -1,  5,  6, -1, -1,  5, -1, 14,  3, -1,
+    -1, 12,  1, -1, 10, -1, -1,  9, 10, -1, -1, 11, 10, 10, 10, -1,
+     8, -1, -1, 11, -1,  0, 13, -1, -1, 11, 11, 11, 10, -1, -1, 11,
+    12, 12, -1, 12, -1, 12, 13, -1, -1, 12, 15, -1, 10, -1, -1,  7,
+    -1, 12, 13, -1, 13, -1, 13, 13,  6, -1, -1, 11, -1, 14, 13, -1,
+     8, -1, -1,  9, -1,  9,  9,  9, -1,  2, 15, -1, 10, -1, -1,  9,
+     8,  8,  8, -1,  8, -1, -1,  9,  8, -1, -1, 11, -1, 14,  3, -1,
+    -1, 12, 15, -1,  4, -1, -1,  9, 15, -1, 15, 15, -1, 14, 15, -1,
+     8, -1, -1,  5, -1, 14, 13, -1, -1, 14, 15, -1, 14, 14, -1, 14
+  };
+
+/* u & 0x7F if odd parity, 255 otherwise. */
+static const uchar oddParity[256] = {
+    0xff, 0x01, 0x02, 0xff, 0x04, 0xff, 0xff, 0x07, 0x08, 0xff, 0xff, 0x0b, 0xff, 0x0d, 0x0e, 0xff,
+    0x10, 0xff, 0xff, 0x13, 0xff, 0x15, 0x16, 0xff, 0xff, 0x19, 0x1a, 0xff, 0x1c, 0xff, 0xff, 0x1f,
+    0x20, 0xff, 0xff, 0x23, 0xff, 0x25, 0x26, 0xff, 0xff, 0x29, 0x2a, 0xff, 0x2c, 0xff, 0xff, 0x2f,
+    0xff, 0x31, 0x32, 0xff, 0x34, 0xff, 0xff, 0x37, 0x38, 0xff, 0xff, 0x3b, 0xff, 0x3d, 0x3e, 0xff,
+    0x40, 0xff, 0xff, 0x43, 0xff, 0x45, 0x46, 0xff, 0xff, 0x49, 0x4a, 0xff, 0x4c, 0xff, 0xff, 0x4f,
+    0xff, 0x51, 0x52, 0xff, 0x54, 0xff, 0xff, 0x57, 0x58, 0xff, 0xff, 0x5b, 0xff, 0x5d, 0x5e, 0xff,
+    0xff, 0x61, 0x62, 0xff, 0x64, 0xff, 0xff, 0x67, 0x68, 0xff, 0xff, 0x6b, 0xff, 0x6d, 0x6e, 0xff,
+    0x70, 0xff, 0xff, 0x73, 0xff, 0x75, 0x76, 0xff, 0xff, 0x79, 0x7a, 0xff, 0x7c, 0xff, 0xff, 0x7f,
+    0x00, 0xff, 0xff, 0x03, 0xff, 0x05, 0x06, 0xff, 0xff, 0x09, 0x0a, 0xff, 0x0c, 0xff, 0xff, 0x0f,
+    0xff, 0x11, 0x12, 0xff, 0x14, 0xff, 0xff, 0x17, 0x18, 0xff, 0xff, 0x1b, 0xff, 0x1d, 0x1e, 0xff,
+    0xff, 0x21, 0x22, 0xff, 0x24, 0xff, 0xff, 0x27, 0x28, 0xff, 0xff, 0x2b, 0xff, 0x2d, 0x2e, 0xff,
+    0x30, 0xff, 0xff, 0x33, 0xff, 0x35, 0x36, 0xff, 0xff, 0x39, 0x3a, 0xff, 0x3c, 0xff, 0xff, 0x3f,
+    0xff, 0x41, 0x42, 0xff, 0x44, 0xff, 0xff, 0x47, 0x48, 0xff, 0xff, 0x4b, 0xff, 0x4d, 0x4e, 0xff,
+    0x50, 0xff, 0xff, 0x53, 0xff, 0x55, 0x56, 0xff, 0xff, 0x59, 0x5a, 0xff, 0x5c, 0xff, 0xff, 0x5f,
+    0x60, 0xff, 0xff, 0x63, 0xff, 0x65, 0x66, 0xff, 0xff, 0x69, 0x6a, 0xff, 0x6c, 0xff, 0xff, 0x6f,
+    0xff, 0x71, 0x72, 0xff, 0x74, 0xff, 0xff, 0x77, 0x78, 0xff, 0xff, 0x7b, 0xff, 0x7d, 0x7e, 0xff
+  };
+
+static inline uchar Revert8(uchar inp) {
+  return revert8[inp];
 }
 
 uint16_t Revert16(uint16_t inp) {
@@ -42,49 +105,76 @@ uchar RevertNibbles(uchar inp) {
    return (inp & 0xF0) >> 4 | (inp & 0xF) << 4;
 }
 
-uchar Hamming_8_4(uchar aByte) {
-   uchar lookup[] = {
-       21,   2,  73,  94, 100, 115,  56,  47,
-      208, 199, 140, 155, 161, 182, 253, 234 };
-   return lookup[aByte];
-}
-
-int HammingDistance_8(uchar a, uchar b) {
-   int i, ret = 0;
-   int mask[] = {1,2,4,8,16,32,64,128};
-   uchar XOR  = a ^ b;
-   
-   for (i=0; i<8; i++)
-       ret += (XOR & mask[i]) >> i;
-   return ret;
+/* Revert8() of Count bytes; eight at once by swapping bits, bit pairs
+ * and nibbles within each byte of a 64bit word.
+ */
+static void Revert8(uchar * Dest, const uchar * Src, int Count) {
+  int i = 0;
+  for (; i + 8 <= Count; i += 8) {
+      uint64_t x;
+      memcpy(&x, Src + i, 8);
+      x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+      x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+      x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+      memcpy(Dest + i, &x, 8);
+      }
+  for (; i < Count; i++)
+      Dest[i] = revert8[Src[i]];
 }
 
 uchar OddParity(uchar u) {
-   int i;
-   int mask[] = {1,2,4,8,16,32,64,128};
-   uchar p=0;
-
-   for (i=0; i<8; i++)
-       p += (u & mask[i]) >> i;
+   return oddParity[u];
+}
 
-   return p&1?u&0x7F:255;
+static inline bool Parity(uint32_t u) {
+   u ^= u >> 16;
+   u ^= u >> 8;
+   return oddParity[u & 0xFF] != 255;
 }
 
 int DeHamming_8_4(uchar aByte) {
-  
-   for (int i=0; i<16; i++)
-       if (HammingDistance_8(Hamming_8_4(i),aByte) < 2)
-          return i;
+   return dehamming_8_4[aByte];
+}
 
-   return -1; // 2 or more bit errors: non recoverable.
+/* DeHamming_8_4() of Count bytes, 0xFF for bytes with two or more bit errors.
+ * false, if there was any of them.
+ */
+static bool DeHamming_8_4(const uchar * Src, uchar * Dest, int Count) {
+   signed char all = 0;
+   for (int i = 0; i < Count; i++) {
+       signed char d = dehamming_8_4[Src[i]];
+       all |= d;
+       Dest[i] = d;
+       }
+   return all >= 0;
 }
 
-uint32_t DeHamming_24_18(uchar * data) {
-  //FIXME: add bit error detection and correction.
-  return ((*(data + 0) >> 2) & 0x1) |
-         ((*(data + 0) >> 3) & 0xE) |
-         (uint32_t) ((*(data+1) & 0x7F) << 4 ) |
-         (uint32_t) ((*(data+2) & 0x7F) << 11);
+/* Hamming 24/18 (ETS 300 706, 8.3): P1..P5 give odd parity over the bits
+ * whose position 1..23 has bit 0..4 set, P6 odd parity over all 24 bits.
+ * Single bit errors are corrected, -1 on two bit errors.
+ */
+int32_t DeHamming_24_18(const uchar * data) {
+  static const uint32_t checks[5] = { 0x555555, 0x666666, 0x787878, 0x007F80, 0x7F8000 };
+  uint32_t word = data[0] | data[1] << 8 | data[2] << 16;
+  int syndrome = 0;
+
+  for (int i = 0; i < 5; i++)
+      if (! Parity(word & checks[i]))
+         syndrome |= 1 << i;
+
+  if (! Parity(word)) {
+     if (syndrome > 23)
+        return -1;
+     if (syndrome)
+        word ^= 1 << (syndrome - 1);  // else: P6 itself
+     }
+  else if (syndrome)
+     return -1;
+
+  return ((word >> 2) & 0x1) |
+         ((word >> 3) & 0xE) |
+         ((word >> 4) & 0x7F0) |
+         ((word >> 5) & 0x3F800);
 }
 
 static inline uint8_t CharToInt(uchar c) {
@@ -104,7 +194,7 @@ void cSwReceiver::Receive(uchar * Data, int Length) {
   uchar * p;
   int count = 184;
   
-  if (stopped || !Running()) return;
+  if (stopped || !active) return;
  
   // pointer to new PES header or next 184byte payload of current PES packet
   p = &Data[4];
@@ -119,7 +209,14 @@ void cSwReceiver::Receive(uchar * Data, int Length) {
       p+=10+PES_header_data_length; count-=10+PES_header_data_length;   
       }
 
-  buffer->Put(p, count);
+  // data units never cross TS packets, 300472 4.3
+  cMutexLock lock(&mutex);
+  if (! active) return;
+  Decode(p, count);
+  if ((++TsCount >= NOCNI_PACKETS) && ! hits)
+     stopped = true; // no network identification on this channel.
+  if (stopped || ((int) started.Elapsed() > TIMEOUT * 1000))
+     finished.Broadcast();
 }
 
 void cSwReceiver::DecodePacket(uchar * data) {
@@ -136,8 +233,7 @@ void cSwReceiver::DecodePacket(uchar * data) {
          uchar * p = &MsbFirst[3];
          
          /* convert data from lsb first to msb first */
-         for (i = 3; i<16; i++)     
-             MsbFirst[i]=Revert8(data[i]);
+         Revert8(&MsbFirst[3], &data[3], 13);
          
          cni_vps = (p[10] & 0x03) << 10 |
                    (p[11] & 0xC0) << 2  |
@@ -147,7 +243,7 @@ void cSwReceiver::DecodePacket(uchar * data) {
          if (cni_vps && GetCniNameVPS()) {
             if (CNI_DBG)
                dlog(3, "cni_vps = 0x%.3x -> %s", cni_vps, GetCniNameVPS());
-            if (++hits > MAXHITS) stopped = true;
+            Hit(cniVps, GetCniNameVPS());
             }
          }
          break;
@@ -155,8 +251,7 @@ void cSwReceiver::DecodePacket(uchar * data) {
       case 0x02: // EBU teletext
          {
          /* convert data from lsb first to msb first */
-         for (i = 4; i<46; i++)
-             MsbFirst[i]=Revert8(data[i]);
+         Revert8(&MsbFirst[4], &data[4], 42);
 
          /* decode magazine and packet number */
          aByte = DeHamming_8_4(MsbFirst[4]);
@@ -168,12 +263,15 @@ void cSwReceiver::DecodePacket(uchar * data) {
          switch (PacketNumber) {
             case 0: /* page header X/0 */
                {             
-               uchar * p = &MsbFirst[6];               
-               pagenumber = DeHamming_8_4(*(p)) + 10 * DeHamming_8_4(*(p+1)); p += 2;
-               subpage  =  DeHamming_8_4(*(p++));
-               subpage |= (DeHamming_8_4(*(p++)) & 0x7) << 4;
-               subpage |=  DeHamming_8_4(*(p++)) << 7;
-               subpage |= (DeHamming_8_4(*(p++)) & 0x3) << 11;
+               uchar * p;
+               uchar h[6];
+               if (! DeHamming_8_4(&MsbFirst[6], h, 6))
+                  break; // page address not recoverable.
+               pagenumber = h[0] + 10 * h[1];
+               subpage  =  h[2];
+               subpage |= (h[3] & 0x7) << 4;
+               subpage |=  h[4] << 7;
+               subpage |= (h[5] & 0x3) << 11;
                if (Magazine == 1 && ! pagenumber) {
                   int bytes = 32;
                   p = &MsbFirst[14];
@@ -240,7 +338,7 @@ void cSwReceiver::DecodePacket(uchar * data) {
                             if (CNI_DBG)
                                dlog(3, "cni_cr_idx = %.2X%.3d -> %s",
                                     cni_cr_idx>>8, cni_cr_idx&255, GetCniNameCrIdx());
-                            if (++hits > MAXHITS) stopped = true;
+                            Hit(cniCrIdx, GetCniNameCrIdx());
                             }
                          }
                       }
@@ -255,8 +353,11 @@ void cSwReceiver::DecodePacket(uchar * data) {
                 */
                uchar * p = &MsbFirst[7];
                for (int i=0; i<13; i++) {
-                   uint32_t value = DeHamming_24_18(p); p+=3;
+                   int32_t value = DeHamming_24_18(p); p+=3;
                    uint16_t data_word_A, mode_description, data_word_B;
+
+                   if (value < 0)
+                      continue; // two bit errors.
                    
                    data_word_A      = (value >> 0 ) & 0x3F;
                    mode_description = (value >> 6 ) & 0x1F;
@@ -268,7 +369,7 @@ void cSwReceiver::DecodePacket(uchar * data) {
                            if (cni_X_26 && GetCniNameX26()) {
                               if (CNI_DBG)
                                  dlog(3, "cni_X_26 = 0x%.4x -> %s", cni_X_26, GetCniNameX26());
-                              if (++hits > MAXHITS) stopped = true;
+                              Hit(cniX26, GetCniNameX26());
                               }
                            }
                        }
@@ -288,21 +389,23 @@ void cSwReceiver::DecodePacket(uchar * data) {
                       if ((cni_8_30_1 == 0xC0C0) || (cni_8_30_1 == 0xA101))
                          cni_8_30_1 = 0; // known wrong values.
                      
-                      if (cni_8_30_1 && GetCniNameFormat1())
+                      if (cni_8_30_1 && GetCniNameFormat1()) {
                          if (CNI_DBG)
                             dlog(3, "cni_8_30_1 = 0x%.4x -> %s", cni_8_30_1, GetCniNameFormat1());
-                         if (++hits > MAXHITS) stopped = true;
+                         Hit(cniFormat1, GetCniNameFormat1());
+                         }
                       }
                       break;
                    case 2:
                    case 3:
                       /* ETS 300 706: Table 19: Coding of Packet 8/30 Format 2 */
                       {
-                      uchar Data[256];
+                      uchar Data[33];
                       unsigned CNI_0, CNI_1, CNI_2, CNI_3;
 
+                      DeHamming_8_4(&MsbFirst[13], Data, 33);
                       for (i=0; i<33; i++)
-                          Data[i]=RevertNibbles(DeHamming_8_4(MsbFirst[13+i]));
+                          Data[i]=RevertNibbles(Data[i]);
 
                       CNI_0 = (Data[2] & 0xF) >> 0;
                       CNI_2 = (Data[3] & 0xC) >> 2;
@@ -311,10 +414,11 @@ void cSwReceiver::DecodePacket(uchar * data) {
 
                       cni_8_30_2 = CNI_0 << 12 | CNI_1 << 8 | CNI_2 << 6 | CNI_3; 
                       
-                      if (cni_8_30_2 && GetCniNameFormat2())
+                      if (cni_8_30_2 && GetCniNameFormat2()) {
                          if (CNI_DBG)
                             dlog(3, "cni_8_30_2 = 0x%.4x -> %s", cni_8_30_2, GetCniNameFormat2());
-                         if (++hits > MAXHITS) stopped = true;
+                         Hit(cniFormat2, GetCniNameFormat2());
+                         }
                       }
                       break;
                    default:;
@@ -331,7 +435,6 @@ void cSwReceiver::DecodePacket(uchar * data) {
 }
 
 void cSwReceiver::Decode(uchar * data, int count) {
-  if (count < 184) return;
 
   while (count >= 46 && !stopped) { 
     switch (*data) {  // EN 300472 Table 4 data_unit_id
@@ -340,29 +443,45 @@ void cSwReceiver::Decode(uchar * data, int count) {
            DecodePacket(data);
         default:;     // wss, closed_caption, stuffing
         }
-    data += 46; count -= 46; buffer->Del(46);
+    data += 46; count -= 46;
     }
 }
 
-void cSwReceiver::Action() {
-  uchar * bp;
-  int count;
+/* the network is settled, if two sources agree on it or one source gave it
+ * SETTLED_REPEATS times in a row. Conflicting sources need more hits.
+ */
+void cSwReceiver::Hit(int Source, const char * Network) {
+  if (sourceName[Source] && ! strcmp(sourceName[Source], Network))
+     sourceHits[Source]++;
+  else {
+     sourceName[Source] = Network;
+     sourceHits[Source] = 1;
+     }
+  int agree = 0;
+  for (int i = 0; i < cniSources; i++)
+      if (sourceName[i] && ! strcmp(sourceName[i], Network))
+         agree++;
+  if ((agree >= 2) || (sourceHits[Source] >= SETTLED_REPEATS))
+     settled = true;
+  hits++;
+  if (settled || (hits > MAXHITS))
+     stopped = true;
+}
+
+void cSwReceiver::Wait() {
+  cMutexLock lock(&mutex);
 
-  while (Running() & !stopped) {
-     count = 184;
-     
-     if ((bp = buffer->Get(count))) {
-        Decode(bp, count);      // always N * 46bytes.
-        TsCount++;
-        }
-     else {
-        cCondWait::SleepMs(10); // wait for new data.
-        }
-     if (time(0) > timeout) {        
-        stopped = true;
-        }
+  while (! stopped) {
+     int elapsed = started.Elapsed();
+     int limit = TsCount ? TIMEOUT * 1000 : NODATA_MS;
+     if (elapsed >= limit)
+        break;
+     finished.TimedWait(mutex, limit - elapsed);
      }
-  if (hits < MAXHITS) {
+  active  = false;
+  stopped = true;
+
+  if (! settled) {
      // we're unshure about result.
      if ((hits < MINHITS) || (TsCount < 3)) {
         // probably garbage. clear it.
@@ -370,37 +489,38 @@ void cSwReceiver::Action() {
         fuzzy = false;
         }
      else
-        dlog(3, "   fuzzy result, hits = %d, TsCount = %lu", hits, TsCount);   
+        dlog(3, "   fuzzy result, hits = %d, TsCount = %u", hits, TsCount);   
      }
 }
 
-cSwReceiver::cSwReceiver(cChannel * Channel) : cReceiver(Channel, 100), cThread("ttext") {
+cSwReceiver::cSwReceiver(cChannel * Channel) : cReceiver(Channel, 100) {
 
-   AddPid(Channel->Tpid());
-   stopped = fuzzy = false;
+   tpid = Channel->Tpid();
+   AddPid(tpid);
+   active = stopped = settled = fuzzy = false;
+   memset(sourceHits, 0, sizeof(sourceHits));
+   memset(sourceName, 0, sizeof(sourceName));
    channel = Channel;
-   buffer  = new cRingBufferLinear(MEGABYTE(1),184);
    cni_8_30_1 = cni_8_30_2 = cni_X_26 = cni_vps = cni_cr_idx = 0;
-   hits = 0;
-   timeout = time(0) + TIMEOUT;
+   hits = TsCount = 0;
 }
 
+// old vbi data cached by pvrinput is dropped, as Receive() ignores all data before.
 void cSwReceiver::Reset() {
-   stopped = fuzzy = false;
-   cCondWait::SleepMs(10);
-   buffer->Clear();
+   cMutexLock lock(&mutex);
    cni_8_30_1 = cni_8_30_2 = cni_X_26 = cni_vps = cni_cr_idx = 0;
-   stopped = false;
+   fuzzy = stopped = false;
    hits = TsCount = 0;
-   timeout = time(0) + TIMEOUT;
-   Start();   
+   settled = false;
+   memset(sourceHits, 0, sizeof(sourceHits));
+   memset(sourceName, 0, sizeof(sourceName));
+   started.Set();
+   active = true;
 }
 
 cSwReceiver::~cSwReceiver() {
+   active = false;
    stopped = true;
-   buffer->Clear();
-   DELETENULL(buffer);
-   Cancel(0);
 }
 
 
@@ -1623,14 +1743,108 @@ static const cni_code cni_codes[] = {
 
 #define CNI_COUNT (sizeof(cni_codes)/sizeof(cni_code))
 
+/* sorted indexes into cni_codes[], one per CNI format and one by network
+ * name, built once on plugin load. Equal keys stay in table order, so that
+ * a lookup returns the same entry as a search through the table would do.
+ */
+class cCniIndex {
+private:
+  struct sKey {
+    uint32_t key;
+    uint16_t pos;
+    };
+  sKey     keys[cniFuzzy][CNI_COUNT];   // all sources but cniFuzzy are indexed
+  uint16_t names[CNI_COUNT];
+  static uint32_t Key(int Format, const cni_code * Code);
+  static int CompareKeys(const void * A, const void * B);
+  static int CompareNames(const void * A, const void * B);
+public:
+  cCniIndex(void);
+  const char * Network(int Format, uint32_t Key);
+  uint16_t VpsCni(const char * Network);
+  };
+
+static cCniIndex CniIndex;
+
+uint32_t cCniIndex::Key(int Format, const cni_code * Code) {
+  switch (Format) {
+     case cniFormat1: return Code->ni_8_30_1;
+     case cniFormat2: return Code->c_8_30_2 << 8 | Code->ni_8_30_2;
+     case cniX26:     return Code->a_X_26   << 8 | Code->b_X_26;
+     case cniVps:     return Code->vps__cni;
+     default:         return Code->c_8_30_2 << 16 | Code->cr_idx;
+     }
+}
+
+int cCniIndex::CompareKeys(const void * A, const void * B) {
+  const sKey * a = (const sKey *) A;
+  const sKey * b = (const sKey *) B;
+  if (a->key != b->key)
+     return a->key < b->key ? -1 : 1;
+  return a->pos - b->pos;
+}
+
+int cCniIndex::CompareNames(const void * A, const void * B) {
+  uint16_t a = *(const uint16_t *) A;
+  uint16_t b = *(const uint16_t *) B;
+  int r = strcasecmp(cni_codes[a].network, cni_codes[b].network);
+  return r ? r : a - b;
+}
+
+cCniIndex::cCniIndex(void) {
+  for (int f = 0; f < cniFuzzy; f++) {
+      for (unsigned i = 0; i < CNI_COUNT; i++) {
+          keys[f][i].key = Key(f, &cni_codes[i]);
+          keys[f][i].pos = i;
+          }
+      qsort(keys[f], CNI_COUNT, sizeof(sKey), CompareKeys);
+      }
+  for (unsigned i = 0; i < CNI_COUNT; i++)
+      names[i] = i;
+  qsort(names, CNI_COUNT, sizeof(uint16_t), CompareNames);
+}
+
+// network of the first entry with Key in Format, NULL if none.
+const char * cCniIndex::Network(int Format, uint32_t Key) {
+  const sKey * k = keys[Format];
+  unsigned lo = 0, hi = CNI_COUNT;
+
+  while (lo < hi) {
+     unsigned mid = (lo + hi) / 2;
+     if (k[mid].key < Key)
+        lo = mid + 1;
+     else
+        hi = mid;
+     }
+  if ((lo < CNI_COUNT) && (k[lo].key == Key))
+     return cni_codes[k[lo].pos].network;
+  return NULL;
+}
+
+// VPS cni of the first entry named Network (ignoring case) which has one, 0 if none.
+uint16_t cCniIndex::VpsCni(const char * Network) {
+  unsigned lo = 0, hi = CNI_COUNT;
+
+  while (lo < hi) {
+     unsigned mid = (lo + hi) / 2;
+     if (strcasecmp(cni_codes[names[mid]].network, Network) < 0)
+        lo = mid + 1;
+     else
+        hi = mid;
+     }
+  for (; (lo < CNI_COUNT) && ! strcasecmp(cni_codes[names[lo]].network, Network); lo++)
+      if (cni_codes[names[lo]].vps__cni)
+         return cni_codes[names[lo]].vps__cni;
+  return 0;
+}
+
 
 const char * cSwReceiver::GetCniNameFormat1() {
-  unsigned i;
 
   if (cni_8_30_1) {
-     for (i = 0; i < CNI_COUNT; i++)
-         if (cni_codes[i].ni_8_30_1 == cni_8_30_1)
-            return cni_codes[i].network;
+     const char * network = CniIndex.Network(cniFormat1, cni_8_30_1);
+     if (network)
+        return network;
      if (cni_8_30_2 || cni_X_26 || cni_vps)
         dlog(0, "unknown 8/30/1 cni 0x%.4x (8/30/2 = 0x%.4x; X/26 = 0x%.4x, VPS = 0x%.4x; cr_idx = 0x%.4x) %s",
              cni_8_30_1, cni_8_30_2, cni_X_26, cni_vps, cni_cr_idx, "PLEASE REPORT TO WIRBELSCAN AUTHOR.");
@@ -1640,13 +1854,11 @@ const char * cSwReceiver::GetCniNameFormat1() {
 }
 
 const char * cSwReceiver::GetCniNameFormat2() {
-  uint8_t  c = cni_8_30_2 >> 8;
-  uint8_t  n = cni_8_30_2 & 0xFF;
 
   if (cni_8_30_2) {
-     for (unsigned i = 0; i < CNI_COUNT; i++)
-         if ((cni_codes[i].c_8_30_2 == c) && (cni_codes[i].ni_8_30_2 == n))
-            return cni_codes[i].network;
+     const char * network = CniIndex.Network(cniFormat2, cni_8_30_2);
+     if (network)
+        return network;
      if (cni_8_30_1 || cni_X_26 || cni_vps)
         dlog(0, "unknown 8/30/2 cni 0x%.4x (8/30/1 = 0x%.4x; X/26 = 0x%.4x, VPS = 0x%.4x; cr_idx = 0x%.4x) %s",
              cni_8_30_2, cni_8_30_1, cni_X_26, cni_vps, cni_cr_idx, "PLEASE REPORT TO WIRBELSCAN AUTHOR.");
@@ -1658,9 +1870,9 @@ const char * cSwReceiver::GetCniNameFormat2() {
 const char * cSwReceiver::GetCniNameVPS() {
 
   if (cni_vps) {
-     for (unsigned i = 0; i < CNI_COUNT; i++)
-         if (cni_codes[i].vps__cni == cni_vps)
-            return cni_codes[i].network;
+     const char * network = CniIndex.Network(cniVps, cni_vps);
+     if (network)
+        return network;
      if (cni_8_30_1 || cni_8_30_2 || cni_X_26)
         dlog(0, "unknown VPS cni 0x%.4x (8/30/1 = 0x%.4x; 8/30/2 = 0x%.4x, X/26 = 0x%.4x; cr_idx = 0x%.4x) %s",
              cni_vps, cni_8_30_1, cni_8_30_2, cni_X_26, cni_cr_idx, "PLEASE REPORT TO WIRBELSCAN AUTHOR.");
@@ -1670,12 +1882,11 @@ const char * cSwReceiver::GetCniNameVPS() {
 }
 
 const char * cSwReceiver::GetCniNameX26() {
-  uchar a = cni_X_26 >> 8, b = cni_X_26 & 0xff;
  
   if (cni_X_26) {
-     for (unsigned i = 0; i < CNI_COUNT; i++)
-         if ((cni_codes[i].a_X_26 == a) && (cni_codes[i].b_X_26 == b))
-            return cni_codes[i].network;
+     const char * network = CniIndex.Network(cniX26, cni_X_26);
+     if (network)
+        return network;
      if (cni_8_30_1 || cni_8_30_2 || cni_vps)
         dlog(0, "unknown X/26 cni 0x%.4x (8/30/1 = 0x%.4x; 8/30/2 = 0x%.4x, VPS = 0x%.4x; cr_idx = 0x%.4x) %s",
              cni_X_26, cni_8_30_1, cni_8_30_2, cni_vps, cni_cr_idx, "PLEASE REPORT TO WIRBELSCAN AUTHOR.");
@@ -1688,9 +1899,9 @@ const char * cSwReceiver::GetCniNameCrIdx() {
   uchar c = cni_cr_idx >> 8, idx = cni_cr_idx & 0xff;
  
   if (cni_cr_idx) {
-     for (unsigned i = 0; i < CNI_COUNT; i++)
-         if ((cni_codes[i].c_8_30_2 == c) && (cni_codes[i].cr_idx == idx))
-            return cni_codes[i].network;
+     const char * network = CniIndex.Network(cniCrIdx, c << 16 | idx);
+     if (network)
+        return network;
      if (cni_8_30_1 || cni_8_30_2 || cni_vps || cni_X_26)
         if ((cni_cr_idx&255) >= 100) //invalid anyway otherwise.
         dlog(0, "unknown cr_idx %.2X%.3d (8/30/1 = 0x%.4x; 8/30/2 = 0x%.4x, VPS = 0x%.4x; X/26 = 0x%.4x) %s",
@@ -1706,17 +1917,7 @@ void cSwReceiver::UpdatefromName(const char * name) {
 
   if (! len) return;
 
-  for (unsigned i = 0; i < CNI_COUNT; i++)
-      if (strlen(cni_codes[i].network) == len) {
-         if (! strcasecmp(cni_codes[i].network, name)) {
-            if (cni_codes[i].vps__cni) {
-               cni_vps_id = cni_codes[i].vps__cni;
-               if (! cni_vps_id)
-                  dlog(0, "%s: missing cni_vps for ""%s""", __FUNCTION__, name);
-               break;
-               }
-            }
-      }
+  cni_vps_id = CniIndex.VpsCni(name);
 
   if (cni_vps_id) {
      cni_vps = cni_vps_id;
@@ -1731,6 +1932,9 @@ void cSwReceiver::UpdatefromName(const char * name) {
      strncpy(fuzzy_network, name, len);
      fuzzy_network[len] = 0;
      }
-  hits++;
-  if (++hits > MAXHITS) stopped = true;
+  hits++; // counts twice, as there's no other source to confirm it.
+  if (cni_vps_id)
+     Hit(cniFuzzy, GetCniNameVPS());
+  else if (++hits > MAXHITS)
+     stopped = true;
 }
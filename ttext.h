@@ -11,16 +11,30 @@
 
 #include <vdr/receiver.h>
 #include <vdr/channels.h>
-#include <vdr/ringbuffer.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
 
-class cSwReceiver : public cReceiver, public cThread {
+// sources of a network identification, see cSwReceiver::Hit()
+enum eCniSource { cniFormat1, cniFormat2, cniX26, cniVps, cniCrIdx, cniFuzzy, cniSources };
+
+/* Decodes VPS and teletext straight from the TS payload in Receive(),
+ * no buffer and no thread. Attach once per channel, call Reset() when tuned
+ * and Wait() for the result; may be reused for all channels with the same Tpid.
+ */
+class cSwReceiver : public cReceiver {
 private:
   cChannel * channel;
-  cRingBufferLinear * buffer;
+  cMutex mutex;
+  cCondVar finished;
+  cTimeMs started;
+  int tpid;
+  bool active;
   bool stopped;
+  bool settled;
   bool fuzzy;
   int hits;
-  int timeout;
+  int sourceHits[cniSources];
+  const char * sourceName[cniSources];
   uint32_t TsCount;
   uint16_t cni_8_30_1;
   uint16_t cni_8_30_2;
@@ -30,15 +44,15 @@ private:
   char fuzzy_network[48];
 protected:
   virtual void Receive(uchar * Data, int Length);
-  virtual void Action();
-  virtual void Stop() { stopped = true; };
   void Decode(uchar * data, int count);
   void DecodePacket(uchar * data);
+  void Hit(int Source, const char * Network);
 public:
   cSwReceiver(cChannel * Channel);
   virtual ~cSwReceiver();
+  int  Tpid() { return tpid; };
   void Reset();
-  bool Finished() { return stopped; }
+  void Wait();   // until the network is settled or there's none, at most TIMEOUT seconds after Reset()
   uint16_t CNI_8_30_1() { return cni_8_30_1; };
   uint16_t CNI_8_30_2() { return cni_8_30_2; };
   uint16_t CNI_X_26()   { return cni_X_26;   };
@@ -14,6 +14,8 @@
 #include "menusetup.h"
 #include "countries.h"
 #include "satellites.h"
+#include "replay.h"
+#include "scanstats.h"
 
 static const char *VERSION        = "0.0.7";
 static const char *DESCRIPTION    = "DVB and pvrinput channel scan for VDR";
@@ -24,6 +26,9 @@ const char * extDesc = DESCRIPTION;
 
 cPluginWirbelscan * thisPlugin;
 
+static const char * replayDir   = NULL;
+static int          replaySpeed = 1;
+
 const char *cPluginWirbelscan::Version(void)
 {
   return VERSION;
@@ -50,7 +55,13 @@ cPluginWirbelscan::~cPluginWirbelscan()
 }
 
 const char cmdLineHelp[] =
-  "  --use-pvrinput   enable pvrinput support\n";
+  "  --use-pvrinput   enable pvrinput support\n"
+  "  --replay=DIR     scan transport stream recordings in DIR instead of\n"
+  "                   dvb hardware, see replay.h for file names\n"
+  "  --replay-speed=N replay at N times 38Mbit/s, 0 = as fast as possible\n"
+  "                   (default: 1)\n"
+  "  --benchmark=FILE append timing and counters of each scan to FILE,\n"
+  "                   one line of JSON per scan\n";
 
 const char *cPluginWirbelscan::CommandLineHelp(void)
 {
@@ -63,13 +74,22 @@ bool cPluginWirbelscan::ProcessArgs(int argc, char *argv[])
   // Implement command line argument processing here if applicable.
   int c;
   static struct option long_options[] = {
-     { "use-pvrinput", no_argument, NULL, 'p' },
-     {  NULL         , no_argument, NULL,  0  }};
+     { "use-pvrinput", no_argument,       NULL, 'p' },
+     { "replay",       required_argument, NULL, 'r' },
+     { "replay-speed", required_argument, NULL, 's' },
+     { "benchmark",    required_argument, NULL, 'b' },
+     {  NULL         , no_argument,       NULL,  0  }};
 
-  while ((c = getopt_long(argc, argv, "p", long_options, NULL)) != -1) {
+  while ((c = getopt_long(argc, argv, "pr:s:b:", long_options, NULL)) != -1) {
         switch (c) {
           case 'p': wSetup.enable_pvrinput = true;
                     break;
+          case 'r': replayDir = optarg;
+                    break;
+          case 's': replaySpeed = max(atoi(optarg), 0);
+                    break;
+          case 'b': ScanStats.SetFile(optarg);
+                    break;
           default:  return false;
           }
         }
@@ -79,6 +99,9 @@ bool cPluginWirbelscan::ProcessArgs(int argc, char *argv[])
 bool cPluginWirbelscan::Initialize(void)
 {
   // Initialize any background activities the plugin shall perform.
+  StartLogWriter();
+  if (replayDir && !cReplayDevice::Create(replayDir, replaySpeed))
+     esyslog("wirbelscan: no recordings in %s", replayDir);
   return true;
 }
 
@@ -92,6 +115,8 @@ void cPluginWirbelscan::Stop(void)
 {
   // Stop any background activities the plugin shall perform.
   stopScanners();
+  CloseFrontends();
+  StopLogWriter();
 }
 
 void cPluginWirbelscan::Housekeeping(void)
@@ -140,6 +165,10 @@ bool cPluginWirbelscan::SetupParse(const char *Name, const char *Value)
   else if (!strcasecmp(Name, "user0"))           wSetup.user[0]=atol(Value);
   else if (!strcasecmp(Name, "user1"))           wSetup.user[1]=atol(Value);
   else if (!strcasecmp(Name, "user2"))           wSetup.user[2]=atol(Value);
+  else if (!strcasecmp(Name, "parallel_tables")) wSetup.parallel_tables=atoi(Value);
+  else if (!strcasecmp(Name, "pmt_filters"))     wSetup.pmt_filters=atoi(Value);
+  else if (!strcasecmp(Name, "incremental"))     wSetup.incremental=atoi(Value);
+  else if (!strcasecmp(Name, "warm_start"))      wSetup.warm_start=atoi(Value);
   else return false;                                              
   return true;
 }
@@ -165,6 +194,10 @@ void cPluginWirbelscan::StoreSetup(void)
   SetupStore("user0",           wSetup.user[0]);
   SetupStore("user1",           wSetup.user[1]);
   SetupStore("user2",           wSetup.user[2]);
+  SetupStore("parallel_tables", wSetup.parallel_tables);
+  SetupStore("pmt_filters",     wSetup.pmt_filters);
+  SetupStore("incremental",     wSetup.incremental);
+  SetupStore("warm_start",      wSetup.warm_start);
   cCondWait::SleepMs(500);
   Setup.Save();
 }
@@ -374,6 +407,18 @@ bool cPluginWirbelscan::Service(const char *Id, void *Data)
      }
   free(service);
 
+  if (0 > asprintf(&service, "%sGet%s", SPlugin, SStats)) {
+     dlog(0, "%s (%d): could not allocate memory", __FUNCTION__, __LINE__);
+     return false;
+     }
+  if (strcmp(Id, service) == 0) {
+     free(service);
+     if (! Data) return true; // check for support
+     ScanStats.GetHistograms((cWirbelscanStats *) Data);
+     return true;
+     }
+  free(service);
+
   return false;
 }
 
@@ -382,6 +427,8 @@ const char **cPluginWirbelscan::SVDRPHelpPages(void)
   static const char * SVDRHelp[] = {
     "S_START\n"
     "    Start scan",
+    "S_WARM\n"
+    "    Start scan, seeded from the transponders of the last scan",
     "S_STOP\n"
     "    Stop scan(s) (if any)",
     "S_TERR\n"
@@ -417,6 +464,12 @@ const char **cPluginWirbelscan::SVDRPHelpPages(void)
     "    list satellites",
     "QUERY\n"
     "    return plugin version, current setup and service versions",
+    "STATS [RESET]\n"
+    "    list time spent in scan states since vdr start, one line per\n"
+    "    delivery system and state:\n"
+    "    <system> <state> <count> <sum ms> <max ms> <histogram>\n"
+    "    histogram: 16 counts of durations 2^i..2^(i+1)-1 ms, i = 0..15\n"
+    "    RESET clears all of them.",
     NULL
     };
   return SVDRHelp;
@@ -432,10 +485,11 @@ cString cPluginWirbelscan::SVDRPCommand(const char *Command, const char *Option,
   else if cmd("S_PVR"   ) { return DoScan(wSetup.DVB_Type = PVRINPUT)   ? "PVRx50 scan started"    : "Could not start PVRx50 scan.";   }
   else if cmd("S_PVR_FM") { return DoScan(wSetup.DVB_Type = PVRINPUT_FM)? "PVRx50 FM scan started" : "Could not start PVRx50 FM scan.";}
   else if cmd("S_START" ) { return DoScan(wSetup.DVB_Type)              ? "starting scan"          : "Could not start scan.";          }
+  else if cmd("S_WARM"  ) { return DoScan(wSetup.DVB_Type, true)        ? "starting warm scan"     : "Could not start scan.";          }
   else if cmd("S_STOP"  ) { DoStop();       return "stopping scan(s)";  }
   else if cmd("STORE"   ) { StoreSetup();   return "setup stored.";     }
   else if cmd("SETUP"   ) {
-    cMySetup d;
+    cMySetup d = wSetup;  // fields not in the setup string stay as they are
 
     if (12 != sscanf(Option, "%i:%i:%i:%i:%i:%i:%i:%i:%i:%i:%i:%u",
               &d.verbosity, &d.logFile,
@@ -471,7 +525,8 @@ cString cPluginWirbelscan::SVDRPCommand(const char *Command, const char *Option,
                             "setup api:      %s\n"
                             "country api:    %s\n"
                             "sat api:        %s\n"
-                            "user api:       %s",
+                            "user api:       %s\n"
+                            "stats api:      %s",
                             VERSION,
                             wSetup.verbosity,
                             wSetup.logFile,
@@ -490,7 +545,20 @@ cString cPluginWirbelscan::SVDRPCommand(const char *Command, const char *Option,
                             SSetup,
                             SCountry,
                             SSat,
-                            SUser);
+                            SUser,
+                            SStats);
+    }
+  else if cmd("STATS") {
+    if (Option && !strcasecmp(Option, "RESET")) {
+      ScanStats.ClearHistograms();
+      return "statistics cleared.";
+      }
+    cString s = ScanStats.HistogramsToString();
+    if (!**s) {
+      ReplyCode = 901;
+      return "no statistics yet.";
+      }
+    return s;
     }
   else if cmd("LSTC") {
     cString s = "";
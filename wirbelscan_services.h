@@ -53,6 +53,7 @@ namespace WIRBELSCAN_SERVICE {
 #define SCountry "Country#0001"    // get list of country IDs and Names
 #define SSat     "Sat#0001"        // get list of satellite IDs and Names
 #define SUser    "User#0002"       // get/set single user transponder, GetUser#XXXX/SetUser#XXXX
+#define SStats   "Stats#0001"      // get scan state latency histograms, GetStats#XXXX
 
 /* --- wirbelscan_GetVersion -------------------------------------------------
  * Query wirbelscans versions, will fail only if plugin version doesnt support service at all.
@@ -188,6 +189,41 @@ typedef struct {
 #include <stdint.h>
 #endif
 
+/* --- wirbelscan_GetStats --------------------------------------------------
+ * Query how long scans stayed in their states, accumulated since vdr start
+ * for each delivery system. Service() expects a pointer to cWirbelscanStats.
+ *
+ * buckets[i] counts state durations of 2^i .. 2^(i+1)-1 ms, buckets[0] also
+ * those below 1ms and buckets[STATS_BUCKETS - 1] all of 2^(STATS_BUCKETS - 1)ms
+ * and more. Delivery systems are indexed by DVB_Type (DVB-T = 0, DVB-C = 1,
+ * DVB-S/S2 = 2, ATSC = 5); 3 and 4 (pvrinput) stay empty.
+ */
+
+#define STATS_BUCKETS 16
+#define STATS_SYSTEMS 6
+
+typedef enum {
+  StatsTune        = 0,                          // tuning, until lock or giving up
+  StatsScanNit     = 1,                          // NIT actual and other
+  StatsScanPat     = 2,                          // PAT and PMTs
+  StatsScanSdt     = 3,                          // SDT actual
+  StatsScanEit     = 4,                          // EIT
+  StatsAddChannels = 5,                          // adding channels to vdr
+  StatsScanTables  = 6,                          // NIT, PAT/PMT and SDT at the same time (setup parallel_tables)
+  StatsStates      = 7,
+} s_stats_state;
+
+typedef struct {
+  uint32_t count;                                // number of times the state was left
+  uint32_t sum_ms;                               // total time spent in state
+  uint32_t max_ms;                               // longest stay in state
+  uint32_t buckets[STATS_BUCKETS];               // see above
+} cWirbelscanHistogram;
+
+typedef struct {
+  cWirbelscanHistogram histogram[STATS_SYSTEMS][StatsStates];
+} cWirbelscanStats;
+
 #define P(v,b,p) ((v & ((1 << b) -1)) << p)
 #define G(v,b,p) ((v >> p) & ((1 << b) -1))
 